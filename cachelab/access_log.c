@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "access_log.h"
+
+#define TEXT_SIZE (1 << 20)
+#define MAX_LINE 128 /* longer than any verbose line */
+#define NUM_RECORDS 65536
+
+/* " hit", " miss eviction hit" and so on, by result, victim and MODIFY. */
+static char suffixes[CACHE_EVICTION + 1][VICTIM_SWAP + 1][2][48];
+static size_t suffix_lens[CACHE_EVICTION + 1][VICTIM_SWAP + 1][2];
+
+static const char mode_names[] = {
+    [INST] = 'I',
+    [LOAD] = 'L',
+    [STORE] = 'S',
+    [MODIFY] = 'M',
+};
+
+static void *allocate(size_t size) {
+  void *p = malloc(size);
+  if (!p) {
+    printf("malloc failed");
+    exit(1);
+  }
+  return p;
+}
+
+static void build_suffixes(void) {
+  for (int r = CACHE_HIT; r <= CACHE_EVICTION; r++) {
+    for (int v = VICTIM_MISS; v <= VICTIM_SWAP; v++) {
+      for (int m = 0; m < 2; m++) {
+        char *s = suffixes[r][v][m];
+        if (r == CACHE_HIT) {
+          strcpy(s, " hit");
+        } else {
+          strcpy(s, r == CACHE_EVICTION ? " miss eviction" : " miss");
+          if (v != VICTIM_MISS) {
+            strcat(s, v == VICTIM_SWAP ? " victim-swap" : " victim-hit");
+          }
+        }
+        strcat(s, m ? " hit\n" : "\n");
+        suffix_lens[r][v][m] = strlen(s);
+      }
+    }
+  }
+}
+
+/*
+ * access_log_open - Start logging. Verbose lines go to stdout, records to
+ * event_file if it is not NULL.
+ */
+void access_log_open(access_log *l, bool verbose, const char *event_file,
+                     const cache_config *config) {
+  memset(l, 0, sizeof(*l));
+  if (verbose) {
+    build_suffixes();
+    l->text = allocate(TEXT_SIZE);
+    l->active = true;
+  }
+  if (event_file) {
+    l->events = fopen(event_file, "wb");
+    if (!l->events) {
+      printf("Unable to open event log: %s.\n", event_file);
+      exit(1);
+    }
+    event_log_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EVENT_LOG_MAGIC, sizeof(header.magic));
+    header.version = EVENT_LOG_VERSION;
+    header.num_set_bits = config->num_set_bits;
+    header.num_block_bits = config->num_block_bits;
+    header.associativity = config->associativity;
+    fwrite(&header, sizeof(header), 1, l->events);
+    l->records = allocate(NUM_RECORDS * sizeof(event_record));
+    l->active = true;
+  }
+}
+
+/*
+ * format_hex - Write x in hex, padded with zeros to width digits, and
+ * return the end.
+ */
+static char *format_hex(char *p, uint64_t x, int width) {
+  char digits[TRACE_MAX_DIGITS];
+  int n = 0;
+  do {
+    digits[n++] = "0123456789abcdef"[x & 0xf];
+    x >>= 4;
+  } while (x);
+  while (n < width) {
+    digits[n++] = '0';
+  }
+  while (n) {
+    *p++ = digits[--n];
+  }
+  return p;
+}
+
+static char *format_decimal(char *p, uint32_t x) {
+  char digits[10];
+  int n = 0;
+  do {
+    digits[n++] = '0' + x % 10;
+    x /= 10;
+  } while (x);
+  while (n) {
+    *p++ = digits[--n];
+  }
+  return p;
+}
+
+/*
+ * access_log_write - Log one access. source is the trace the access came
+ * from, printed in front of the line when it is not negative.
+ */
+void access_log_write(access_log *l, const mem_access *access, int source,
+                      cache_result result, victim_result victim,
+                      const cache_update *update) {
+  if (l->text) {
+    if (l->text_len > TEXT_SIZE - MAX_LINE) {
+      fwrite(l->text, 1, l->text_len, stdout);
+      l->text_len = 0;
+    }
+    char *p = l->text + l->text_len;
+    if (source >= 0) {
+      p = format_decimal(p, source);
+      *p++ = ' ';
+    }
+    /* The line as it is in the trace, without the leading space. */
+    *p++ = mode_names[access->mode];
+    *p++ = ' ';
+    if (access->mode == INST) {
+      *p++ = ' ';
+    }
+    p = format_hex(p, access->address, access->digits);
+    *p++ = ',';
+    p = format_decimal(p, access->size);
+    int modify = access->mode == MODIFY;
+    memcpy(p, suffixes[result][victim][modify],
+           suffix_lens[result][victim][modify]);
+    l->text_len = p - l->text + suffix_lens[result][victim][modify];
+  }
+  if (l->events) {
+    if (l->num_records == NUM_RECORDS) {
+      fwrite(l->records, sizeof(event_record), l->num_records, l->events);
+      l->num_records = 0;
+    }
+    event_record *e = l->records + l->num_records++;
+    e->address = access->address;
+    e->victim_tag = result == CACHE_EVICTION ? update->victim_tag : 0;
+    e->set_idx = update->set_idx;
+    e->mode = access->mode;
+    e->result = result;
+    e->victim = victim;
+    e->source = source >= 0 ? source : 0;
+  }
+}
+
+/* access_log_flush - Write the buffered verbose lines before other output. */
+void access_log_flush(access_log *l) {
+  if (l->text_len) {
+    fwrite(l->text, 1, l->text_len, stdout);
+    l->text_len = 0;
+  }
+}
+
+void access_log_close(access_log *l) {
+  access_log_flush(l);
+  free(l->text);
+  if (l->events) {
+    fwrite(l->records, sizeof(event_record), l->num_records, l->events);
+    if (ferror(l->events) || fclose(l->events) != 0) {
+      printf("Unable to write event log.\n");
+      exit(1);
+    }
+    free(l->records);
+  }
+}
@@ -0,0 +1,55 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cache.h"
+#include "trace.h"
+#include "victim.h"
+
+#define EVENT_LOG_MAGIC "CSIMEVNT"
+#define EVENT_LOG_VERSION 1
+
+/* Event log header, followed by one event_record per access. */
+typedef struct event_log_header {
+  char magic[8];
+  uint32_t version;
+  int32_t num_set_bits;
+  int32_t num_block_bits;
+  int32_t associativity;
+} event_log_header;
+
+typedef struct event_record {
+  uint64_t address;
+  uint64_t victim_tag; /* tag of the evicted line, 0 without eviction */
+  uint32_t set_idx;
+  uint8_t mode;   /* access_mode */
+  uint8_t result; /* cache_result */
+  uint8_t victim; /* victim_result of a victim or miss cache */
+  uint8_t source; /* trace of several, 0 with one */
+} event_record;
+
+/*
+ * The outcome of every access, as verbose text on stdout and as records in
+ * a binary event log. Both are buffered and written in large chunks.
+ */
+typedef struct access_log {
+  bool active;
+  char *text; /* verbose lines, NULL if not verbose */
+  size_t text_len;
+  FILE *events; /* NULL without event log */
+  event_record *records;
+  size_t num_records;
+} access_log;
+
+void access_log_open(access_log *l, bool verbose, const char *event_file,
+                     const cache_config *config);
+void access_log_write(access_log *l, const mem_access *access, int source,
+                      cache_result result, victim_result victim,
+                      const cache_update *update);
+void access_log_flush(access_log *l);
+void access_log_close(access_log *l);
+
+#endif
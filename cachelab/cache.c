@@ -0,0 +1,809 @@
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "cache.h"
+#include "common.h"
+#include "profile.h"
+
+/* Dirty bit of a saved line, tags never use bit 63. */
+#define SAVED_DIRTY (1UL << 63)
+
+/* A way that was never filled. No tag matches it, as blocks are addresses
+   shifted right by at least one bit. */
+#define WAY_EMPTY (~0UL)
+
+#define AGE_DIRTY 0x80
+#define AGE_MASK 0x7f
+
+static cache_kernel pick_kernel(const cache *c);
+
+static int cache_line_cmp(void *a, void *b) {
+  cache_line *la = (cache_line *)a;
+  cache_line *lb = (cache_line *)b;
+  if (la->tag == lb->tag) {
+    return 0;
+  } else if (la->tag < lb->tag) {
+    return -1;
+  } else {
+    return 1;
+  }
+}
+
+static void reset_set(cache_set *set) {
+  linked_list_initialize(&set->ll, offsetof(cache_line, ll_node));
+  splay_tree_initialize(&set->st, offsetof(cache_line, st_node),
+                        cache_line_cmp);
+}
+
+static void *allocate(size_t size) {
+  void *p = calloc(1, size);
+  if (!p) {
+    printf("malloc failed");
+    exit(1);
+  }
+  return p;
+}
+
+static void linked_initialize(cache *c) {
+  c->sets = allocate(c->num_sets * sizeof(cache_set));
+  for (uint64_t i = 0; i < c->num_sets; i++) {
+    c->sets[i].lines = allocate(c->associativity * sizeof(cache_line));
+    reset_set(&c->sets[i]);
+  }
+}
+
+static int floor_log2(uint64_t x) {
+  int bits = 0;
+  while (x >>= 1) {
+    bits++;
+  }
+  return bits;
+}
+
+static void compact_initialize(cache *c) {
+  uint64_t num_lines = c->num_sets * c->associativity;
+  if (c->associativity > CACHE_COMPACT_MAX_ASSOCIATIVITY) {
+    printf("The compact cache supports at most %d lines per set.\n",
+           CACHE_COMPACT_MAX_ASSOCIATIVITY);
+    exit(1);
+  }
+  c->tag_bits =
+      c->address_bits - floor_log2(c->num_sets) - c->num_block_bits;
+  if (c->tag_bits < 0) {
+    c->tag_bits = 0;
+  }
+  if (c->tag_bits <= 32) {
+    c->tags32 = allocate(num_lines * sizeof(uint32_t));
+  } else {
+    c->tags64 = allocate(num_lines * sizeof(uint64_t));
+  }
+  c->ages = allocate(num_lines);
+  c->fill = allocate(c->num_sets);
+}
+
+static void ways_initialize(cache *c) {
+  uint64_t num_lines = c->num_sets * c->associativity;
+  c->tags64 = allocate(num_lines * sizeof(uint64_t));
+  memset(c->tags64, 0xff, num_lines * sizeof(uint64_t));
+  c->order = allocate(num_lines);
+  c->fill = allocate(c->num_sets);
+}
+
+static void skewed_initialize(cache *c) {
+  uint64_t num_lines = c->num_sets * c->associativity;
+  c->tags64 = allocate(num_lines * sizeof(uint64_t));
+  c->stamps = allocate(num_lines * sizeof(uint64_t));
+}
+
+void cache_initialize(cache *c, const cache_config *config) {
+  memset(c, 0, sizeof(*c));
+  c->num_set_bits = config->num_set_bits;
+  c->num_block_bits = config->num_block_bits;
+  c->associativity = config->associativity;
+  c->num_sets = config->num_sets ? config->num_sets : 1UL << c->num_set_bits;
+  c->index = config->index;
+  /* A single set has no bits to fold the tag into, and the fold of
+     cache_decode() would never end. */
+  if (c->index == INDEX_XOR && c->num_set_bits == 0) {
+    c->index = INDEX_BITS;
+  }
+  if (c->index == INDEX_BITS || c->index == INDEX_XOR) {
+    assert(c->num_sets == 1UL << c->num_set_bits);
+  }
+  c->sub_block_bits = config->sub_block_bits;
+  c->address_bits =
+      config->address_bits ? config->address_bits : CACHE_ADDRESS_BITS;
+  if (c->sub_block_bits) {
+    assert(c->sub_block_bits <= 6 && c->sub_block_bits <= c->num_block_bits);
+    c->valid = allocate(c->num_sets * c->associativity * sizeof(uint64_t));
+    c->sub_dirty = allocate(c->num_sets * c->associativity * sizeof(uint64_t));
+  }
+  if (c->index == INDEX_SKEWED) {
+    c->layout = CACHE_SKEWED;
+    skewed_initialize(c);
+  } else if (config->compact) {
+    c->layout = CACHE_COMPACT;
+    compact_initialize(c);
+  } else if (c->associativity <= 16 &&
+             (c->associativity & (c->associativity - 1)) == 0) {
+    c->layout = CACHE_WAYS;
+    ways_initialize(c);
+  } else {
+    c->layout = CACHE_LINKED;
+    linked_initialize(c);
+  }
+  c->kernel = pick_kernel(c);
+}
+
+void cache_destroy(cache *c) {
+  if (c->sets) {
+    for (uint64_t i = 0; i < c->num_sets; i++) {
+      free(c->sets[i].lines);
+    }
+  }
+  free(c->sets);
+  free(c->tags32);
+  free(c->tags64);
+  free(c->ages);
+  free(c->fill);
+  free(c->order);
+  free(c->stamps);
+  free(c->valid);
+  free(c->sub_dirty);
+  memset(c, 0, sizeof(*c));
+}
+
+/* skew_hash - The set of block in the given way of a skewed cache. */
+static inline uint64_t skew_hash(const cache *c, uint64_t block, int way) {
+  uint64_t x = block + (way + 1) * 0x9e3779b97f4a7c15UL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+  return (x ^ (x >> 31)) % c->num_sets;
+}
+
+/*
+ * cache_decode - Split an address into set index and tag. The tag of a
+ * skewed cache is the block address, its set index is that of way 0.
+ */
+void cache_decode(const cache *c, uint64_t address, uint64_t *set_idx,
+                  uint64_t *tag) {
+  uint64_t block = (address & ~(1UL << 63)) >> c->num_block_bits;
+  uint64_t mask = c->num_sets - 1;
+  switch (c->index) {
+  case INDEX_BITS:
+    *set_idx = block & mask;
+    *tag = block >> c->num_set_bits;
+    break;
+  case INDEX_XOR:
+    *set_idx = 0;
+    for (uint64_t x = block; x; x >>= c->num_set_bits) {
+      *set_idx ^= x & mask;
+    }
+    *tag = block >> c->num_set_bits;
+    break;
+  case INDEX_PRIME:
+    *set_idx = block % c->num_sets;
+    *tag = block / c->num_sets;
+    break;
+  case INDEX_SKEWED:
+    *set_idx = skew_hash(c, block, 0);
+    *tag = block;
+    break;
+  }
+}
+
+/* cache_block - The block address a set index and tag were decoded from. */
+uint64_t cache_block(const cache *c, uint64_t set_idx, uint64_t tag) {
+  uint64_t low = 0;
+  switch (c->index) {
+  case INDEX_BITS:
+    return tag << c->num_set_bits | set_idx;
+  case INDEX_XOR:
+    for (uint64_t x = tag; x; x >>= c->num_set_bits) {
+      low ^= x & (c->num_sets - 1);
+    }
+    return tag << c->num_set_bits | (set_idx ^ low);
+  case INDEX_PRIME:
+    return tag * c->num_sets + set_idx;
+  case INDEX_SKEWED:
+    break;
+  }
+  return tag;
+}
+
+/* cache_set_dirty - Mark the line in slot as modified. */
+void cache_set_dirty(cache *c, uint64_t slot) {
+  switch (c->layout) {
+  case CACHE_COMPACT:
+    c->ages[slot] |= AGE_DIRTY;
+    break;
+  case CACHE_WAYS:
+    c->tags64[slot] |= SAVED_DIRTY;
+    break;
+  case CACHE_SKEWED:
+    c->stamps[slot] |= SAVED_DIRTY;
+    break;
+  default:
+    c->sets[slot / c->associativity].lines[slot % c->associativity].dirty = 1;
+    break;
+  }
+  if (c->sub_block_bits) {
+    c->sub_dirty[slot] = c->valid[slot];
+  }
+}
+
+/*
+ * linked_empty - A line of the set in ways that was never filled, or NULL.
+ */
+static cache_line *linked_empty(const cache *c, cache_set *set,
+                                uint64_t ways) {
+  for (int way = 0; way < c->associativity; way++) {
+    if ((ways >> way & 1) && !set->lines[way].ll_node.next) {
+      return set->lines + way;
+    }
+  }
+  return NULL;
+}
+
+/* linked_lru - The least recently used line of the set in ways. */
+static cache_line *linked_lru(cache_set *set, uint64_t ways) {
+  for (linked_list_node *node = set->ll.sentinel.prev;
+       node != &set->ll.sentinel; node = node->prev) {
+    cache_line *line = container_of(node, cache_line, ll_node);
+    if (ways >> (line - set->lines) & 1) {
+      return line;
+    }
+  }
+  return NULL;
+}
+
+static cache_result linked_access(cache *c, uint64_t set_idx, uint64_t tag,
+                                  bool write, uint64_t ways,
+                                  cache_update *update) {
+  cache_set *set;
+  cache_line line, *hit, *new_line;
+  cache_result result = CACHE_MISS;
+
+  set = c->sets + set_idx;
+  line.tag = tag;
+  PROF_DEPTH(splay_tree_depth(&set->st, &line));
+  PROF_BEGIN(PROF_LOOKUP);
+  hit = splay_tree_search(&set->st, &line);
+  PROF_END(PROF_LOOKUP);
+  if (hit) {
+    PROF_BEGIN(PROF_UPDATE);
+    linked_list_remove(&set->ll, hit);
+    linked_list_push_front(&set->ll, hit);
+    hit->dirty |= write;
+    PROF_END(PROF_UPDATE);
+    update->slot = set_idx * c->associativity + (hit - set->lines);
+    return CACHE_HIT;
+  }
+  assert(set->st.size == set->ll.size);
+  new_line = NULL;
+  if (set->st.size < c->associativity) {
+    new_line = c->partitioned ? linked_empty(c, set, ways)
+                              : set->lines + set->st.size;
+  }
+  if (!new_line) {
+    PROF_BEGIN(PROF_EVICT);
+    new_line = c->partitioned ? linked_lru(set, ways)
+                              : linked_list_back(&set->ll);
+    linked_list_remove(&set->ll, new_line);
+    assert(splay_tree_remove(&set->st, new_line));
+    PROF_END(PROF_EVICT);
+    update->victim_tag = new_line->tag;
+    update->victim_dirty = new_line->dirty;
+    result = CACHE_EVICTION;
+  }
+  PROF_BEGIN(PROF_UPDATE);
+  new_line->tag = tag;
+  new_line->dirty = write;
+  linked_list_push_front(&set->ll, new_line);
+  assert(splay_tree_insert(&set->st, new_line));
+  PROF_END(PROF_UPDATE);
+  update->slot = set_idx * c->associativity + (new_line - set->lines);
+  return result;
+}
+
+static inline uint64_t compact_tag(const cache *c, uint64_t i) {
+  return c->tags32 ? c->tags32[i] : c->tags64[i];
+}
+
+static inline void compact_set_tag(cache *c, uint64_t i, uint64_t tag) {
+  if (c->tags32) {
+    c->tags32[i] = tag;
+  } else {
+    c->tags64[i] = tag;
+  }
+}
+
+/*
+ * compact_touch - Make way the MRU line of its set: every line that was
+ * more recently used than it ages by one.
+ */
+static inline void compact_touch(cache *c, uint64_t base, int fill, int way) {
+  uint8_t *ages = c->ages + base;
+  uint8_t age = ages[way] & AGE_MASK;
+  for (int w = 0; w < fill; w++) {
+    if ((ages[w] & AGE_MASK) < age) {
+      ages[w]++;
+    }
+  }
+  ages[way] &= AGE_DIRTY;
+}
+
+static cache_result compact_access(cache *c, uint64_t set_idx, uint64_t tag,
+                                   bool write, cache_update *update) {
+  uint64_t base = set_idx * c->associativity;
+  int fill = c->fill[set_idx];
+  int way;
+  cache_result result = CACHE_MISS;
+
+  if (tag >> c->tag_bits) {
+    printf("Address beyond %d bits, too wide for the compact cache.\n",
+           c->address_bits);
+    exit(1);
+  }
+  PROF_BEGIN(PROF_LOOKUP);
+  for (way = 0; way < fill; way++) {
+    if (compact_tag(c, base + way) == tag) {
+      break;
+    }
+  }
+  PROF_END(PROF_LOOKUP);
+  if (way < fill) {
+    PROF_BEGIN(PROF_UPDATE);
+    compact_touch(c, base, fill, way);
+    c->ages[base + way] |= write ? AGE_DIRTY : 0;
+    PROF_END(PROF_UPDATE);
+    update->slot = base + way;
+    return CACHE_HIT;
+  }
+  if (fill < c->associativity) {
+    way = fill;
+    c->ages[base + way] = fill;
+    c->fill[set_idx] = ++fill;
+  } else {
+    PROF_BEGIN(PROF_EVICT);
+    for (way = 0; (c->ages[base + way] & AGE_MASK) != fill - 1; way++) {
+    }
+    PROF_END(PROF_EVICT);
+    update->victim_tag = compact_tag(c, base + way);
+    update->victim_dirty = c->ages[base + way] & AGE_DIRTY;
+    result = CACHE_EVICTION;
+  }
+  PROF_BEGIN(PROF_UPDATE);
+  compact_set_tag(c, base + way, tag);
+  compact_touch(c, base, fill, way);
+  c->ages[base + way] = write ? AGE_DIRTY : 0;
+  PROF_END(PROF_UPDATE);
+  update->slot = base + way;
+  return result;
+}
+
+/*
+ * ways_empty - A way of the set in ways that was never filled, or assoc if
+ * there is none.
+ */
+static inline __attribute__((always_inline)) int
+ways_empty(const cache *c, const uint8_t *order, int fill, int assoc,
+           uint64_t ways) {
+  if (fill == assoc) {
+    return assoc;
+  }
+  if (!c->partitioned) {
+    return fill;
+  }
+  uint64_t used = 0;
+  for (int pos = 0; pos < fill; pos++) {
+    used |= 1UL << order[pos];
+  }
+  uint64_t empty = ways & ~used & ((1UL << assoc) - 1);
+  return empty ? __builtin_ctzl(empty) : assoc;
+}
+
+/*
+ * direct_access - ways_access() of a direct-mapped set: one tag compare,
+ * and a store on a miss. The order of a single way never changes.
+ */
+static inline __attribute__((always_inline)) cache_result
+direct_access(cache *c, uint64_t set_idx, uint64_t tag, bool write,
+              cache_update *update) {
+  uint64_t *line = c->tags64 + set_idx;
+  uint64_t dirty = write ? SAVED_DIRTY : 0;
+  cache_result result = CACHE_MISS;
+
+  update->slot = set_idx;
+  PROF_BEGIN(PROF_LOOKUP);
+  bool hit = (*line & ~SAVED_DIRTY) == tag;
+  PROF_END(PROF_LOOKUP);
+  if (hit) {
+    *line |= dirty;
+    return CACHE_HIT;
+  }
+  if (*line == WAY_EMPTY) {
+    c->fill[set_idx] = 1;
+  } else {
+    update->victim_tag = *line & ~SAVED_DIRTY;
+    update->victim_dirty = (*line & SAVED_DIRTY) != 0;
+    result = CACHE_EVICTION;
+  }
+  *line = tag | dirty;
+  return result;
+}
+
+/*
+ * ways_access - Look for the tag in the ways of the set, most recently used
+ * first, and move the way that holds it afterwards to the front of the
+ * order. The kernels pass a constant assoc, which unrolls the loops.
+ */
+static inline __attribute__((always_inline)) cache_result
+ways_access(cache *c, uint64_t set_idx, uint64_t tag, bool write, int assoc,
+            uint64_t ways, cache_update *update) {
+  if (assoc == 1) {
+    return direct_access(c, set_idx, tag, write, update);
+  }
+  uint64_t base = set_idx * assoc;
+  uint64_t *tags = c->tags64 + base;
+  uint8_t *order = c->order + base;
+  uint64_t dirty = write ? SAVED_DIRTY : 0;
+  int fill = c->fill[set_idx];
+  int pos, way;
+  cache_result result = CACHE_MISS;
+
+  PROF_BEGIN(PROF_LOOKUP);
+  for (pos = 0; pos < fill; pos++) {
+    if ((tags[order[pos]] & ~SAVED_DIRTY) == tag) {
+      break;
+    }
+  }
+  PROF_END(PROF_LOOKUP);
+  if (pos < fill) {
+    way = order[pos];
+    tags[way] |= dirty;
+    result = CACHE_HIT;
+  } else {
+    way = ways_empty(c, order, fill, assoc, ways);
+    if (way < assoc) {
+      c->fill[set_idx] = fill + 1;
+    } else {
+      PROF_BEGIN(PROF_EVICT);
+      for (pos = fill - 1; !(ways >> order[pos] & 1); pos--) {
+      }
+      way = order[pos];
+      PROF_END(PROF_EVICT);
+      update->victim_tag = tags[way] & ~SAVED_DIRTY;
+      update->victim_dirty = (tags[way] & SAVED_DIRTY) != 0;
+      result = CACHE_EVICTION;
+    }
+    tags[way] = tag | dirty;
+  }
+  PROF_BEGIN(PROF_UPDATE);
+  for (; pos > 0; pos--) {
+    order[pos] = order[pos - 1];
+  }
+  order[0] = way;
+  PROF_END(PROF_UPDATE);
+  update->slot = base + way;
+  return result;
+}
+
+/*
+ * skewed_access - Look for the block in its line of every way and replace
+ * the least recently used of those lines in ways on a miss, an empty one
+ * first.
+ */
+static cache_result skewed_access(cache *c, uint64_t block, bool write,
+                                  uint64_t ways, cache_update *update) {
+  uint64_t victim = 0;
+  uint64_t oldest = UINT64_MAX;
+  uint64_t dirty = write ? SAVED_DIRTY : 0;
+  cache_result result = CACHE_MISS;
+
+  PROF_BEGIN(PROF_LOOKUP);
+  for (int way = 0; way < c->associativity; way++) {
+    uint64_t i = way * c->num_sets + skew_hash(c, block, way);
+    uint64_t stamp = c->stamps[i] & ~SAVED_DIRTY;
+    if (stamp && c->tags64[i] == block) {
+      PROF_END(PROF_LOOKUP);
+      c->stamps[i] = ++c->clock | (c->stamps[i] & SAVED_DIRTY) | dirty;
+      update->slot = i;
+      return CACHE_HIT;
+    }
+    if ((ways >> way & 1) && stamp < oldest) {
+      oldest = stamp;
+      victim = i;
+    }
+  }
+  PROF_END(PROF_LOOKUP);
+  if (oldest) {
+    update->victim_tag = c->tags64[victim];
+    update->victim_dirty = c->stamps[victim] & SAVED_DIRTY;
+    result = CACHE_EVICTION;
+  }
+  c->tags64[victim] = block;
+  c->stamps[victim] = ++c->clock | dirty;
+  update->slot = victim;
+  return result;
+}
+
+/*
+ * sector_access - Track the sub-blocks of the line an access went to. A tag
+ * hit on a sub-block that is not present is a sub-block miss, which only
+ * fetches that sub-block. A new sector starts out with just the accessed
+ * sub-block, its dirty sub-blocks are written back on eviction.
+ */
+static cache_result sector_access(cache *c, cache_result result,
+                                  int sub_block, bool write,
+                                  cache_update *update) {
+  uint64_t bit = 1UL << sub_block;
+  uint64_t slot = update->slot;
+  uint64_t sub_block_size = 1UL << (c->num_block_bits - c->sub_block_bits);
+
+  if (result == CACHE_HIT) {
+    if (!(c->valid[slot] & bit)) {
+      c->valid[slot] |= bit;
+      update->fill_bytes = sub_block_size;
+      result = CACHE_SUB_BLOCK_MISS;
+    }
+  } else {
+    if (result == CACHE_EVICTION) {
+      update->writeback_bytes =
+          __builtin_popcountl(c->sub_dirty[slot]) * sub_block_size;
+    }
+    c->valid[slot] = bit;
+    c->sub_dirty[slot] = 0;
+    update->fill_bytes = sub_block_size;
+  }
+  if (write) {
+    c->sub_dirty[slot] |= bit;
+  }
+  return result;
+}
+
+/*
+ * finish_access - Add the block address of the victim and the traffic to
+ * the next level to the update of an access.
+ */
+static inline cache_result finish_access(cache *c, uint64_t address,
+                                         bool write, cache_result result,
+                                         cache_update *update) {
+  if (result == CACHE_EVICTION) {
+    update->victim_block = cache_block(c, update->set_idx, update->victim_tag);
+    update->writeback_block = update->victim_block;
+  }
+  if (c->sub_block_bits) {
+    int sub_block = ((address & ~(1UL << 63)) >>
+                     (c->num_block_bits - c->sub_block_bits)) &
+                    ((1 << c->sub_block_bits) - 1);
+    return sector_access(c, result, sub_block, write, update);
+  }
+  if (result != CACHE_HIT) {
+    update->fill_bytes = 1UL << c->num_block_bits;
+  }
+  if (update->victim_dirty) {
+    update->writeback_bytes = 1UL << c->num_block_bits;
+  }
+  return result;
+}
+
+/*
+ * cache_access - Simulate an access to address. The update tells where the
+ * block ended up, what it evicted and the traffic to the next level.
+ */
+cache_result cache_access(cache *c, uint64_t address, bool write,
+                          cache_update *update) {
+  if (c->kernel) {
+    return c->kernel(c, address, write, update);
+  }
+  return cache_access_ways(c, address, write, ~0UL, update);
+}
+
+/*
+ * cache_access_ways - Simulate an access that hits in any way but may only
+ * fill and evict the ways set in the mask, as with cache allocation
+ * technology.
+ */
+cache_result cache_access_ways(cache *c, uint64_t address, bool write,
+                               uint64_t ways, cache_update *update) {
+  cache_result result;
+
+  if (!c->partitioned && c->associativity <= 64 &&
+      (~ways & (~0UL >> (64 - c->associativity)))) {
+    assert(c->layout != CACHE_COMPACT && ways);
+    c->partitioned = true;
+  }
+
+  memset(update, 0, sizeof(*update));
+  PROF_BEGIN(PROF_DECODE);
+  cache_decode(c, address, &update->set_idx, &update->tag);
+  PROF_END(PROF_DECODE);
+  assert(update->set_idx < c->num_sets);
+  update->block = (address & ~(1UL << 63)) >> c->num_block_bits;
+  switch (c->layout) {
+  case CACHE_COMPACT:
+    result = compact_access(c, update->set_idx, update->tag, write, update);
+    break;
+  case CACHE_WAYS:
+    result = ways_access(c, update->set_idx, update->tag, write,
+                         c->associativity, ways, update);
+    break;
+  case CACHE_SKEWED:
+    result = skewed_access(c, update->tag, write, ways, update);
+    break;
+  default:
+    result = linked_access(c, update->set_idx, update->tag, write, ways,
+                           update);
+    break;
+  }
+  return finish_access(c, address, write, result, update);
+}
+
+/*
+ * WAYS_KERNEL - Define name, cache_access() of a ways cache with E lines per
+ * set, bit indexing and no sectors. With full set, the cache is a single
+ * fully associative set: the tag is the block address and the set index a
+ * constant 0. A direct-mapped access is a single tag compare.
+ */
+#define WAYS_KERNEL(name, E, full)                                             \
+  static cache_result name(cache *c, uint64_t address, bool write,             \
+                           cache_update *update) {                             \
+    memset(update, 0, sizeof(*update));                                        \
+    PROF_BEGIN(PROF_DECODE);                                                   \
+    update->block = (address & ~(1UL << 63)) >> c->num_block_bits;             \
+    update->set_idx = full ? 0 : update->block & (c->num_sets - 1);            \
+    update->tag = full ? update->block : update->block >> c->num_set_bits;     \
+    PROF_END(PROF_DECODE);                                                     \
+    cache_result result = ways_access(c, update->set_idx, update->tag, write,  \
+                                      E, ~0UL, update);                        \
+    return finish_access(c, address, write, result, update);                   \
+  }
+
+WAYS_KERNEL(ways_kernel_1, 1, false)
+WAYS_KERNEL(ways_kernel_2, 2, false)
+WAYS_KERNEL(ways_kernel_4, 4, false)
+WAYS_KERNEL(ways_kernel_8, 8, false)
+WAYS_KERNEL(ways_kernel_16, 16, false)
+WAYS_KERNEL(full_kernel_1, 1, true)
+WAYS_KERNEL(full_kernel_2, 2, true)
+WAYS_KERNEL(full_kernel_4, 4, true)
+WAYS_KERNEL(full_kernel_8, 8, true)
+WAYS_KERNEL(full_kernel_16, 16, true)
+
+/*
+ * pick_kernel - The specialized cache_access() for a cache, or NULL to go
+ * through cache_access_ways(). Fully associative caches of more than 16
+ * lines stay linked: the splay tree finds a tag in O(log E), where a
+ * kernel would scan every way.
+ */
+static cache_kernel pick_kernel(const cache *c) {
+  static const cache_kernel ways_kernels[] = {
+      ways_kernel_1, ways_kernel_2, ways_kernel_4, ways_kernel_8,
+      ways_kernel_16,
+  };
+  static const cache_kernel full_kernels[] = {
+      full_kernel_1, full_kernel_2, full_kernel_4, full_kernel_8,
+      full_kernel_16,
+  };
+  if (c->index != INDEX_BITS || c->sub_block_bits ||
+      c->layout != CACHE_WAYS) {
+    return NULL;
+  }
+  int log = floor_log2(c->associativity);
+  return c->num_sets == 1 ? full_kernels[log] : ways_kernels[log];
+}
+
+static void save_line(cache *c, FILE *fp, uint64_t slot, uint64_t tag,
+                      bool dirty) {
+  uint64_t saved = tag | (dirty ? SAVED_DIRTY : 0);
+  fwrite(&saved, sizeof(saved), 1, fp);
+  if (c->sub_block_bits) {
+    fwrite(c->valid + slot, sizeof(uint64_t), 1, fp);
+    fwrite(c->sub_dirty + slot, sizeof(uint64_t), 1, fp);
+  }
+}
+
+/*
+ * cache_save - Write the lines of every set, MRU first, as a line count
+ * followed by the tags with the dirty bit folded into bit 63, and the valid
+ * and dirty masks in a sector cache. Linked, compact and ways caches write
+ * the same format, skewed caches cannot be saved.
+ */
+void cache_save(cache *c, FILE *fp) {
+  assert(c->layout != CACHE_SKEWED);
+  for (uint64_t i = 0; i < c->num_sets; i++) {
+    if (c->layout == CACHE_COMPACT) {
+      uint64_t base = i * c->associativity;
+      uint32_t size = c->fill[i];
+      fwrite(&size, sizeof(size), 1, fp);
+      for (int age = 0; age < size; age++) {
+        for (int way = 0; way < size; way++) {
+          if ((c->ages[base + way] & AGE_MASK) == age) {
+            save_line(c, fp, base + way, compact_tag(c, base + way),
+                      c->ages[base + way] & AGE_DIRTY);
+          }
+        }
+      }
+    } else if (c->layout == CACHE_WAYS) {
+      uint64_t base = i * c->associativity;
+      uint32_t size = c->fill[i];
+      fwrite(&size, sizeof(size), 1, fp);
+      for (int pos = 0; pos < size; pos++) {
+        uint64_t slot = base + c->order[base + pos];
+        save_line(c, fp, slot, c->tags64[slot] & ~SAVED_DIRTY,
+                  c->tags64[slot] & SAVED_DIRTY);
+      }
+    } else {
+      cache_set *set = c->sets + i;
+      uint32_t size = set->ll.size;
+      fwrite(&size, sizeof(size), 1, fp);
+      for (linked_list_node *node = set->ll.sentinel.next;
+           node != &set->ll.sentinel; node = node->next) {
+        cache_line *line = container_of(node, cache_line, ll_node);
+        save_line(c, fp, i * c->associativity + (line - set->lines),
+                  line->tag, line->dirty);
+      }
+    }
+  }
+}
+
+/*
+ * cache_restore - Read back the state written by cache_save. The lists are
+ * rebuilt in the saved order and the splay trees from the restored lines.
+ */
+bool cache_restore(cache *c, FILE *fp) {
+  assert(c->layout != CACHE_SKEWED);
+  for (uint64_t i = 0; i < c->num_sets; i++) {
+    cache_set *set = c->layout == CACHE_LINKED ? c->sets + i : NULL;
+    uint64_t base = i * c->associativity;
+    uint32_t size;
+    if (set) {
+      reset_set(set);
+    } else if (c->layout == CACHE_WAYS) {
+      memset(c->tags64 + base, 0xff, c->associativity * sizeof(uint64_t));
+    }
+    if (fread(&size, sizeof(size), 1, fp) != 1 || size > c->associativity) {
+      return false;
+    }
+    for (uint32_t j = 0; j < size; j++) {
+      uint64_t saved, tag;
+      bool dirty;
+      if (fread(&saved, sizeof(saved), 1, fp) != 1) {
+        return false;
+      }
+      tag = saved & ~SAVED_DIRTY;
+      dirty = (saved & SAVED_DIRTY) != 0;
+      if (c->sub_block_bits &&
+          (fread(c->valid + base + j, sizeof(uint64_t), 1, fp) != 1 ||
+           fread(c->sub_dirty + base + j, sizeof(uint64_t), 1, fp) != 1)) {
+        return false;
+      }
+      if (c->layout == CACHE_WAYS) {
+        c->tags64[base + j] = tag | (dirty ? SAVED_DIRTY : 0);
+        c->order[base + j] = j;
+        continue;
+      }
+      if (!set) {
+        if (tag >> c->tag_bits) {
+          return false;
+        }
+        compact_set_tag(c, base + j, tag);
+        c->ages[base + j] = j | (dirty ? AGE_DIRTY : 0);
+        continue;
+      }
+      cache_line *line = set->lines + j;
+      line->tag = tag;
+      line->dirty = dirty;
+      linked_list_push_back(&set->ll, line);
+      if (!splay_tree_insert(&set->st, line)) {
+        return false;
+      }
+    }
+    if (!set) {
+      c->fill[i] = size;
+    }
+  }
+  return true;
+}
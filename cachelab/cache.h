@@ -0,0 +1,150 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "linked_list.h"
+#include "splay_tree.h"
+
+/* Widest address the compact representation has to hold a tag for. */
+#define CACHE_ADDRESS_BITS 48
+/* The compact representation keeps LRU ages in 7 bits. */
+#define CACHE_COMPACT_MAX_ASSOCIATIVITY 128
+/* Way masks are 64 bits wide. */
+#define CACHE_MAX_PARTITIONED_ASSOCIATIVITY 64
+
+typedef enum {
+  INDEX_BITS,   /* the address bits above the block offset */
+  INDEX_XOR,    /* those bits XORed with the upper address bits folded */
+  INDEX_PRIME,  /* block address modulo a (prime) number of sets */
+  INDEX_SKEWED, /* a different hash of the block address for every way */
+} index_function;
+
+typedef struct cache_config {
+  int num_set_bits;
+  int num_block_bits;
+  int associativity;
+  uint64_t num_sets; /* 0 for 2^num_set_bits */
+  index_function index;
+  bool compact;       /* truncated tags and LRU ages in flat arrays */
+  int sub_block_bits; /* a line is a sector of 2^sub_block_bits blocks */
+  int address_bits;   /* 0 for CACHE_ADDRESS_BITS */
+} cache_config;
+
+typedef struct cache_line {
+  uint64_t tag : 63;
+  uint64_t dirty : 1;
+  linked_list_node ll_node;
+  splay_tree_node st_node;
+} cache_line;
+
+/* Lines are kept in a splay tree for lookup and in MRU-first order in ll. */
+typedef struct cache_set {
+  cache_line *lines;
+  linked_list ll;
+  splay_tree st;
+} cache_set;
+
+typedef enum {
+  CACHE_HIT,
+  CACHE_SUB_BLOCK_MISS, /* sector present, sub-block fetched */
+  CACHE_MISS,
+  CACHE_EVICTION, /* miss that evicted the LRU line */
+} cache_result;
+
+/* Where an access went and what it displaced. */
+typedef struct cache_update {
+  uint64_t block; /* address without the block offset */
+  uint64_t set_idx;
+  uint64_t tag;
+  uint64_t slot;         /* line that holds the block now */
+  uint64_t victim_tag;   /* evicted line, for CACHE_EVICTION */
+  uint64_t victim_block; /* block address of the evicted line */
+  bool victim_dirty;
+  uint64_t fill_bytes;      /* fetched from the next level */
+  uint64_t writeback_bytes; /* written back to the next level */
+  uint64_t writeback_block; /* block address of what was written back */
+} cache_update;
+
+typedef enum {
+  CACHE_LINKED,
+  CACHE_COMPACT,
+  CACHE_SKEWED,
+  CACHE_WAYS,
+} cache_layout;
+
+struct cache;
+
+/* cache_access() specialized for a cache, picked by cache_initialize(). */
+typedef cache_result (*cache_kernel)(struct cache *c, uint64_t address,
+                                     bool write, cache_update *update);
+
+/*
+ * A linked cache has a splay tree and an LRU list per set.
+ *
+ * In a compact cache way w of set s is at s * associativity + w in the flat
+ * arrays and the ways in use are the first fill[s] ones. Tags are truncated
+ * to the bits left above the set and block bits and stored as 32-bit values
+ * when they fit. An age of 0 marks the MRU line, bit 7 is the dirty bit.
+ *
+ * A ways cache, used instead of a linked one for 1, 2, 4, 8 or 16 lines per
+ * set, keeps the tag of way w of set s at s * associativity + w in tags64,
+ * with bit 63 as dirty bit, and all ones in a way never filled. order
+ * holds the ways of every set in MRU-first order, the first fill[s] of them
+ * in use.
+ *
+ * A skewed cache indexes every way with its own hash, so a set is no longer
+ * a unit of replacement. Way w is the bank of num_sets lines starting at
+ * w * num_sets, tags are whole block addresses in tags64 and stamps holds
+ * the time of the last use, 0 for an empty line, with bit 63 as dirty bit.
+ *
+ * Linked, ways and skewed caches can be way partitioned: an access may
+ * replace only the ways in its mask. Linked and ways caches fill their
+ * lines in order until the first partitioned access, from then on a line
+ * that was never filled is one that is not on the LRU list or in order.
+ *
+ * Any layout can be a sector cache, where a line is a sector of sub-blocks
+ * that are fetched and written back on their own. The valid and dirty
+ * masks of the sub-blocks are kept per line, indexed like the lines of the
+ * layout.
+ */
+typedef struct cache {
+  int num_set_bits;
+  int num_block_bits;
+  int associativity;
+  uint64_t num_sets;
+  index_function index;
+  cache_layout layout;
+  cache_set *sets;
+  int address_bits;
+  int tag_bits;
+  uint32_t *tags32;
+  uint64_t *tags64;
+  uint8_t *ages;
+  uint8_t *fill;
+  uint8_t *order;
+  uint64_t *stamps;
+  uint64_t clock;
+  int sub_block_bits;
+  uint64_t *valid;
+  uint64_t *sub_dirty;
+  bool partitioned; /* an access was limited to some of the ways */
+  cache_kernel kernel; /* specialized cache_access(), if any */
+} cache;
+
+void cache_initialize(cache *c, const cache_config *config);
+void cache_destroy(cache *c);
+void cache_decode(const cache *c, uint64_t address, uint64_t *set_idx,
+                  uint64_t *tag);
+uint64_t cache_block(const cache *c, uint64_t set_idx, uint64_t tag);
+void cache_set_dirty(cache *c, uint64_t slot);
+cache_result cache_access(cache *c, uint64_t address, bool write,
+                          cache_update *update);
+cache_result cache_access_ways(cache *c, uint64_t address, bool write,
+                               uint64_t ways, cache_update *update);
+void cache_save(cache *c, FILE *fp);
+bool cache_restore(cache *c, FILE *fp);
+
+#endif
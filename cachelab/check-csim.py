@@ -0,0 +1,284 @@
+#!/usr/bin/env python3
+#
+# check-csim.py - Regression checks for the options of csim that csim-ref
+#     does not have, so test-csim and fuzz-csim.py cannot cover them. Every
+#     check runs ./csim in a scratch directory and exits with 1 if one of
+#     them fails. Set CSIM to check another build, e.g. one with
+#     -fsanitize=address.
+#
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+CSIM = os.path.abspath(os.environ.get("CSIM", "./csim"))
+TRACES = os.path.abspath("traces")
+
+#
+# run - run csim in the scratch directory and return its output
+#
+def run(scratch, args):
+    p = subprocess.run([CSIM] + args, cwd=scratch, stdout=subprocess.PIPE,
+                       stderr=subprocess.STDOUT)
+    return p.returncode, p.stdout.decode()
+
+#
+# writeTrace - write a trace of loads to the given addresses
+#
+def writeTrace(scratch, name, addresses):
+    path = os.path.join(scratch, name)
+    with open(path, "w") as f:
+        for address in addresses:
+            f.write(" L %x,4\n" % address)
+    return path
+
+#
+# ask - send a request to a csim server and return its reply, the lines
+# up to the empty one
+#
+def ask(conn, request):
+    conn.sendall((request + "\n").encode())
+    reply = b""
+    while not reply.endswith(b"\n\n"):
+        data = conn.recv(4096)
+        if not data:
+            break
+        reply += data
+    return reply.decode().rstrip("\n")
+
+#
+# checkServeBadRequests - requests that would make the cache or the paging
+# exit are answered with an error, and the server goes on answering
+#
+def checkServeBadRequests(scratch):
+    # Color 0 of 4096 gets more pages than 64 GB of frames hold
+    trace = writeTrace(scratch, "serve.trace",
+                       [i << 24 for i in range(4097)] + [1 << 50])
+    path = os.path.join(scratch, "csim.sock")
+    server = subprocess.Popen([CSIM, "--serve", path, "-t", trace,
+                               "--threads", "1"], cwd=scratch,
+                              stdout=subprocess.DEVNULL)
+    try:
+        for i in range(100):
+            if os.path.exists(path):
+                break
+            time.sleep(0.05)
+        conn = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        conn.connect(path)
+        for request in ["-s 1 -E 200 -b 5 --compact",
+                        "-s 1 -E 2 -b 5 --compact",
+                        "-s 1 -E 2 -b 5 --level 2:200:5:10 --compact",
+                        "-s 1 -E 2 -b 5 --paging color:4096"]:
+            reply = ask(conn, request)
+            if not reply.startswith("error:"):
+                return "%s: no error but %r" % (request, reply)
+        reply = ask(conn, "-s 4 -E 1 -b 4")
+        expected = run(scratch, ["-s", "4", "-E", "1", "-b", "4", "-t",
+                                 trace])[1].rstrip("\n")
+        if reply != expected:
+            return "valid request after errors: %r, not %r" % (reply,
+                                                               expected)
+        ask(conn, "shutdown")
+        conn.close()
+        if server.wait(10) != 0:
+            return "server exited with %d" % server.returncode
+    finally:
+        if server.poll() is None:
+            server.kill()
+            server.wait()
+    if os.path.exists(path):
+        return "server left its socket behind"
+    return None
+
+#
+# checkCosMaxTenants - classes of service with as many traces as csim
+# takes, every class counts the accesses of its trace
+#
+def checkCosMaxTenants(scratch):
+    names = ["yi", "yi2", "dave", "trans"] * 2
+    args = ["-s", "4", "-E", "4", "-b", "4", "--cos", "0:3", "--cos", "7:c"]
+    for name in names:
+        args += ["-t", os.path.join(TRACES, name + ".trace")]
+    code, out = run(scratch, args)
+    if code != 0:
+        return "exited with %d: %s" % (code, out)
+    traces = {}
+    classes = {}
+    for line in out.splitlines():
+        fields = line.split()
+        if fields[0] == "trace":
+            traces[fields[1]] = fields[3:6]
+        elif fields[0] == "class":
+            classes[fields[1]] = [int(f.split(":")[1]) for f in fields[3:6]]
+    if len(traces) != len(names):
+        return "%d traces reported, not %d" % (len(traces), len(names))
+    others = [0, 0, 0]
+    for t, stats in traces.items():
+        stats = [int(f.split(":")[1]) for f in stats]
+        if t in ("0", "7"):
+            if classes.get(t) != stats:
+                return "class %s: %s, not %s" % (t, classes.get(t), stats)
+        else:
+            others = [a + b for a, b in zip(others, stats)]
+    if classes.get("other") != others:
+        return "class other: %s, not %s" % (classes.get("other"), others)
+    return None
+
+#
+# checkResultCacheConcurrent - runs in a directory where another run keeps
+# writing .csim_results store their own numbers, and replay them
+#
+def checkResultCacheConcurrent(scratch):
+    # Long enough that the runs overlap
+    trace = writeTrace(scratch, "cache.trace",
+                       [(i * 7919) % 65536 * 8 for i in range(300000)])
+    configs = [["-s", str(s), "-E", "1", "-b", "4", "-t", trace]
+               for s in range(1, 7)]
+    cache = ["--result-cache", os.path.join(scratch, "cache")]
+    results = os.path.join(scratch, ".csim_results")
+    runs = [subprocess.Popen([CSIM] + config + cache, cwd=scratch,
+                             stdout=subprocess.PIPE) for config in configs]
+    # The results of some other run, written until these are done
+    while any(r.poll() is None for r in runs):
+        with open(results + ".other", "w") as f:
+            f.write("1 2 3\n")
+        os.rename(results + ".other", results)
+    outs = [r.communicate()[0].decode() for r in runs]
+    for config, out in zip(configs, outs):
+        expected = run(scratch, config)[1]
+        if out != expected:
+            return "%s: %r, not %r" % (" ".join(config[:6]), out, expected)
+        replayed = run(scratch, config + cache)[1]
+        if replayed != expected:
+            return "%s replayed: %r, not %r" % (" ".join(config[:6]),
+                                                replayed, expected)
+        with open(results) as f:
+            numbers = f.read().split()
+        if "hits:%s misses:%s evictions:%s" % tuple(numbers) not in replayed:
+            return "%s replayed .csim_results %s" % (" ".join(config[:6]),
+                                                     numbers)
+    return None
+
+#
+# checkVerboseEcho - verbose lines start with the access as it is written
+# in the trace, zero padding of the address included
+#
+def checkVerboseEcho(scratch):
+    trace = os.path.join(TRACES, "trans.trace")
+    code, out = run(scratch, ["-v", "-s", "4", "-E", "2", "-b", "4", "-t",
+                              trace])
+    if code != 0:
+        return "exited with %d: %s" % (code, out)
+    with open(trace) as f:
+        expected = [line[1:].rstrip() for line in f if line[0] == " "]
+    lines = out.splitlines()[:len(expected)]
+    for line, access in zip(lines, expected):
+        if not line.startswith(access + " "):
+            return "%r for %r" % (line, access)
+    return None
+
+#
+# checkBatchPolicies - --opt jobs of a batch simulate Belady's replacement,
+# and jobs with a victim or miss cache report its hits, like the runs with
+# the same options do
+#
+def checkBatchPolicies(scratch):
+    jobs = [["-s", "4", "-E", "2", "-b", "4", "--opt"],
+            ["-s", "4", "-E", "2", "-b", "4"],
+            ["-s", "2", "-E", "4", "-b", "4", "--opt"],
+            ["-s", "2", "-E", "4", "-b", "5", "--opt"],
+            ["-s", "4", "-E", "2", "-b", "4", "--victim-cache", "4"],
+            ["-s", "4", "-E", "2", "-b", "4", "--miss-cache", "4"]]
+    trace = os.path.join(TRACES, "long.trace")
+    job_file = os.path.join(scratch, "jobs")
+    with open(job_file, "w") as f:
+        for job in jobs:
+            f.write(" ".join(job + ["-t", trace]) + "\n")
+    code, out = run(scratch, ["--batch", job_file, "--threads", "2"])
+    if code != 0:
+        return "exited with %d: %s" % (code, out)
+    lines = out.splitlines()
+    header = lines[0].split()
+    for job, line in zip(jobs, lines[1:]):
+        row = dict(zip(header, line.split()))
+        expected = run(scratch, job + ["-t", trace])[1].splitlines()
+        got = "hits:%s misses:%s evictions:%s" % (row["hits"], row["misses"],
+                                                  row["evictions"])
+        if got != expected[0]:
+            return "%s: %s, not %s" % (" ".join(job), got, expected[0])
+        if row["policy"] != ("opt" if "--opt" in job else "lru"):
+            return "%s: policy %s" % (" ".join(job), row["policy"])
+        if "--victim-cache" in job:
+            got = "victim hits:%s swaps:%s" % (row["buffer-hits"],
+                                               row["swaps"])
+        elif "--miss-cache" in job:
+            got = "miss-cache hits:%s" % row["buffer-hits"]
+        else:
+            continue
+        if not expected[1].startswith(got + " "):
+            return "%s: %s, not %s" % (" ".join(job), got, expected[1])
+    return None
+
+#
+# checkXorOneSet - --index xor with a single set ends, and counts as the
+# plain fully associative cache
+#
+def checkXorOneSet(scratch):
+    args = ["-S", "1", "-E", "2", "-b", "4", "-t",
+            os.path.join(TRACES, "yi.trace")]
+    try:
+        p = subprocess.run([CSIM, "--index", "xor"] + args, cwd=scratch,
+                           stdout=subprocess.PIPE, timeout=10)
+    except subprocess.TimeoutExpired:
+        return "did not end"
+    expected = run(scratch, args)[1]
+    if p.returncode != 0 or p.stdout.decode() != expected:
+        return "exited with %d: %r, not %r" % (p.returncode,
+                                               p.stdout.decode(), expected)
+    return None
+
+#
+# checkPagingLargeBlocks - with lines larger than a page, -v, which sees
+# every access, and the coalesced runs without it count the same
+#
+def checkPagingLargeBlocks(scratch):
+    trace = os.path.join(TRACES, "long.trace")
+    for b, paging in [("12", "random"), ("13", "random"), ("14", "random"),
+                      ("22", "huge")]:
+        args = ["-s", "2", "-E", "2", "-b", b, "--paging", paging, "-t",
+                trace]
+        plain = run(scratch, args)[1].splitlines()[0]
+        verbose = [line for line in run(scratch, ["-v"] + args)[1].splitlines()
+                   if line.startswith("hits:")]
+        if verbose != [plain]:
+            return "-b %s --paging %s: %s, with -v %s" % (b, paging, plain,
+                                                          verbose)
+    return None
+
+CHECKS = [checkServeBadRequests, checkCosMaxTenants,
+          checkResultCacheConcurrent, checkVerboseEcho, checkBatchPolicies,
+          checkXorOneSet, checkPagingLargeBlocks]
+
+#
+# main - Main function
+#
+def main():
+    failures = 0
+    for check in CHECKS:
+        scratch = tempfile.mkdtemp(prefix="check-csim.")
+        try:
+            error = check(scratch)
+        finally:
+            shutil.rmtree(scratch)
+        print("%-32s %s" % (check.__name__, "FAIL: " + error if error
+                            else "ok"))
+        failures += error is not None
+    print("%d checks, %d failed" % (len(CHECKS), failures))
+    sys.exit(1 if failures else 0)
+
+# execute main only if called as a script
+if __name__ == "__main__":
+    main()
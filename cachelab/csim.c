@@ -1,251 +1,2419 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
+#include <errno.h>
+#include <glob.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
+#include "access_log.h"
+#include "cache.h"
 #include "cachelab.h"
-#include "linked_list.h"
-#include "splay_tree.h"
-
-typedef enum {
-  /* INST, */ // instruction load ignored
-  LOAD,
-  STORE,
-  MODIFY,
-} access_mode;
-
-typedef struct mem_access {
-  access_mode mode;
-  uint64_t address;
-  /* uint64_t num_bytes; */ /* not needed, assuming aligned access */
-} mem_access;
-
-typedef struct cache_line {
-  uint64_t tag;
-  linked_list_node ll_node;
-  splay_tree_node st_node;
-} cache_line;
-
-typedef struct cache_set {
-  cache_line *lines;
-  linked_list ll;
-  splay_tree st;
-} cache_set;
-
-void simulate(int num_set_bits, int num_block_bits, int associativity,
-              char *trace_file_name, bool verbose);
-bool nextAccess(FILE *trace_file, char *buffer, int buf_size,
-                mem_access *access);
-void decode(uint64_t address, int num_set_bits, int num_block_bits,
-            uint64_t *set_idx, uint64_t *tag);
-int cache_line_cmp(void *a, void *b);
+#include "hierarchy.h"
+#include "opt.h"
+#include "paging.h"
+#include "partition.h"
+#include "pool.h"
+#include "profile.h"
+#include "region.h"
+#include "result_cache.h"
+#include "sketch.h"
+#include "trace.h"
+#include "victim.h"
+
+#define SNAPSHOT_MAGIC "CSIMSNAP"
+#define SNAPSHOT_VERSION 6
+
+/* Traces sharing the cache, told apart by a tag above the address bits. */
+#define MAX_TENANTS 8
+#define TENANT_BITS 3
+
+/* Lines in a cache of a --serve request, so a request cannot exhaust it. */
+#define SERVE_MAX_LINES (1 << 24)
+
+/*
+ * A run of consecutive accesses to the same cache line, or the same
+ * sub-block in a sector cache. Only the first access has to be looked up:
+ * afterwards the line is the most recently used one in its set, so every
+ * other access of the run is a guaranteed hit.
+ */
+typedef struct access_run {
+  mem_access access; /* first access of the run */
+  int repeat_hits;    /* hits from the rest of the run, MODIFY counts twice */
+  bool repeat_writes; /* the rest of the run dirties the line */
+} access_run;
+
+/* Filter stage between the trace parser and the simulator. */
+typedef struct access_filter {
+  trace_reader *trace;
+  int run_bits;  /* address bits below the unit a run covers */
+  bool coalesce; /* off when every access is logged */
+  bool has_next; /* an access of the next run has already been read */
+  mem_access next;
+  uint64_t accesses; /* accesses handed out in runs so far */
+  uint64_t barrier;  /* runs end when this many accesses have been read */
+} access_filter;
+
+typedef struct sim_options {
+  cache_config cache;
+  char *trace_file_names[MAX_TENANTS];
+  int num_traces;
+  cache_config private_l1; /* per trace with several traces, if E > 0 */
+  cache_config icache;     /* instruction loads go here if E > 0 */
+  uint64_t quantum;        /* accesses a trace runs before the next one */
+  size_t ring_depth; /* batches parsed ahead, 0 parses inline */
+  bool verbose;
+  char *event_file_name; /* binary record of every access */
+  bool opt;            /* Belady's optimal replacement instead of LRU */
+  victim_kind victim;  /* buffer probed on misses, if any */
+  int victim_entries;
+  level_config levels[HIERARCHY_MAX_LEVELS]; /* below the simulated cache */
+  int num_levels;
+  bool timing;   /* report cycles and AMAT */
+  bool pipeline; /* every level on its own thread */
+  bool sketch; /* working set per window and the hottest lines and sets */
+  uint64_t window;
+  int top;
+  char *region_file_name; /* hits, misses and evictions per region */
+  paging_config paging;   /* caches see physical addresses, if set */
+  char *cos_targets[PARTITION_MAX_CLASSES]; /* a region or trace number */
+  uint64_t cos_ways[PARTITION_MAX_CLASSES];
+  int num_cos;
+  uint64_t occupancy; /* accesses between occupancy reports, 0 for none */
+  timing_model timing_model;
+  char *checkpoint_file_name; /* snapshot written here, also on SIGUSR1 */
+  uint64_t checkpoint_at;     /* access count to checkpoint at, 0 for none */
+  char *resume_file_name;     /* continue a checkpointed run */
+  char *warm_file_name;       /* start from a snapshot's cache contents */
+  uint64_t warmup;            /* accesses excluded from the statistics */
+  char *batch_file_name;      /* job list to run instead of one simulation */
+  char *socket_name;          /* serve simulations of the trace here */
+  int threads;
+  char *result_cache_dir; /* results of earlier runs, if set */
+} sim_options;
+
+typedef struct sim_stats {
+  int hits;
+  int misses;
+  int evictions;
+  uint64_t sub_block_misses; /* misses in a present sector */
+  uint64_t fill_bytes;
+  uint64_t writeback_bytes;
+  uint64_t victim_hits;  /* misses served by the victim or miss cache */
+  uint64_t victim_swaps; /* victim hits that moved the evicted line over */
+  uint64_t miss_cycles;  /* fetching misses, before overlapping them */
+  uint64_t writeback_cycles;
+} sim_stats;
+
+/* A simulation of a batch, with the trace it runs on. */
+typedef struct batch_job {
+  sim_options opts;
+  int line; /* in the job file */
+  size_t trace;
+  sim_stats stats;
+  level_stats levels[HIERARCHY_MAX_LEVELS];
+  uint64_t pages;  /* mapped by the paging policy */
+  bool pages_full; /* the trace has more pages than there are frames */
+  size_t opt;      /* next uses of an --opt job, in the batch's opt_traces */
+} batch_job;
+
+/* A trace of the batch with the next uses for a block size. */
+typedef struct batch_opt {
+  size_t trace;
+  int num_block_bits;
+  opt_trace t;
+} batch_opt;
+
+/*
+ * A batch of simulations. Every trace is packed once and shared read-only
+ * by the jobs that run on it.
+ */
+typedef struct batch {
+  batch_job *jobs;
+  size_t num_jobs;
+  char **trace_names;
+  packed_trace *traces;
+  size_t num_traces;
+  batch_opt *opt_traces;
+  size_t num_opt_traces;
+  size_t ring_depth;
+} batch;
+
+/*
+ * A simulation server on one packed trace. Every worker of the pool
+ * accepts connections and answers their requests in order. The next uses
+ * --opt needs depend on the block size, they are computed the first time
+ * a request asks for a block size and kept for the following ones.
+ */
+typedef struct server {
+  const char *trace_name;
+  packed_trace trace;
+  uint64_t max_address; /* of the trace, the compact cache has a limit */
+  size_t ring_depth;
+  int listener;
+  volatile bool stopping;
+  pthread_mutex_t opt_lock;
+  opt_trace *opt_traces[CACHE_ADDRESS_BITS]; /* by block bits */
+} server;
+
+/*
+ * A trace sharing the cache with others. With private L1s, stats counts the
+ * accesses the L1 passes on to the shared cache.
+ */
+typedef struct tenant {
+  trace_reader trace;
+  access_filter filter;
+  cache l1;
+  sim_stats l1_stats;
+  sim_stats stats;
+  uint64_t evicted_by_others; /* its lines evicted by another trace */
+  int cos;                    /* class of service in a partitioned cache */
+  bool done;
+} tenant;
+
+/*
+ * Summaries of the trace in fixed memory: the distinct lines of the current
+ * window, and how often every line missed and every set evicted.
+ */
+typedef struct sim_sketches {
+  hll window;
+  uint64_t window_start; /* access count the window started at */
+  count_min missed_lines;
+  count_min evicted_sets;
+} sim_sketches;
+
+/*
+ * Snapshot header, followed by the cache state written by cache_save() and
+ * the buffer written by victim_save().
+ */
+typedef struct snapshot_header {
+  char magic[8];
+  uint32_t version;
+  int32_t num_set_bits;
+  int32_t num_block_bits;
+  int32_t associativity;
+  int32_t index;
+  int32_t sub_block_bits;
+  int32_t victim;
+  int32_t victim_entries;
+  uint64_t num_sets;
+  sim_stats stats;
+  uint64_t accesses;
+  int64_t trace_offset; /* where to reopen the trace */
+  uint64_t trace_skip;  /* accesses to skip after reopening */
+} snapshot_header;
+
+static volatile sig_atomic_t checkpoint_requested = 0;
+
+/* What the simulation summarized, for the result cache. */
+static sim_stats summary;
+static bool summarized = false;
+
+bool parseOptions(int argc, char *argv[], sim_options *opts);
+void simulate(const sim_options *opts);
+void simulateOpt(const sim_options *opts);
+void simulateShared(const sim_options *opts);
+void runBatch(const sim_options *opts);
+void readJobs(const char *file_name, batch *b);
+void loadTrace(size_t trace, void *context);
+void loadOptTrace(size_t opt, void *context);
+void runJob(size_t job, void *context);
+void simulateJob(batch_job *job, const packed_trace *trace);
+void simulateOptJob(batch_job *job, const opt_trace *t);
+void serve(const sim_options *opts);
+void serveClients(size_t worker, void *context);
+bool serveRequest(server *srv, char *line, FILE *out);
+bool fitsServer(const server *srv, const cache_config *config,
+                bool physical, FILE *out);
+const opt_trace *serverOptTrace(server *srv, int num_block_bits);
+void printJob(FILE *out, const batch_job *job);
+void sharedAccess(cache *shared, tenant *tenants, int t, partition *part,
+                  uint64_t address, bool write, cache_result *result,
+                  cache_update *update);
+partition *newPartition(const sim_options *opts, const cache *c,
+                        const region_map *regions, int *classes);
+void reportOccupancy(const sim_options *opts, const partition *part,
+                     uint64_t accesses, uint64_t *next);
+void countAccess(sim_stats *stats, const mem_access *access,
+                 cache_result result, const cache_update *update);
+void chargeMemory(hierarchy *h, int num_block_bits, uint64_t address,
+                  const cache_update *update, sim_stats *stats);
+void printBuffers(FILE *out, const sim_options *opts,
+                  const sim_stats *stats);
+void printTiming(FILE *out, const sim_options *opts,
+                 const level_stats *levels, const sim_stats *stats);
+void printPaging(FILE *out, const sim_options *opts, uint64_t pages);
+void checkPaging(bool full);
+void summarize(int hits, int misses, int evictions);
+sim_sketches *newSketches(const sim_options *opts);
+void sketchAccess(sim_sketches *sk, cache_result result,
+                  const cache_update *update);
+void closeWindow(sim_sketches *sk, uint64_t accesses);
+void printSketches(const sim_sketches *sk, int num_block_bits);
+bool readNext(access_filter *filter);
+bool nextRun(access_filter *filter, access_run *run);
+uint64_t nextBarrier(const sim_options *opts, uint64_t accesses);
+void writeSnapshot(const char *file_name, cache *c, const victim_buffer *v,
+                   const sim_stats *stats, const access_filter *filter);
+void readSnapshot(const char *file_name, cache *c, victim_buffer *v,
+                  sim_stats *stats, snapshot_header *header);
+void checkpointHandler(int signum);
+bool parseCount(const char *arg, uint64_t *count);
+bool parseIndex(const char *arg, index_function *index);
+bool parseEntries(const char *arg, int *entries);
+bool parseLevel(const char *arg, level_config *level);
+bool parseGeometry(const char *arg, cache_config *config);
+bool parseRate(const char *arg, double *rate);
+bool parsePaging(const char *arg, paging_config *config);
+bool parseClass(char *arg, char **target, uint64_t *ways);
+uint64_t largestPrime(uint64_t limit);
+bool openResultCache(const sim_options *opts, int argc, char *argv[],
+                     result_cache *rc);
 void printHelp(char *argv0);
 
 int main(int argc, char *argv[]) {
-  bool verbose = false;
-  int num_set_bits = 0;
-  int num_block_bits = 0;
-  int associativity = 0;
-  char *trace_file_name = NULL;
+  sim_options opts;
+  if (!parseOptions(argc, argv, &opts)) {
+    return 1;
+  }
+
+  result_cache rc;
+  bool cached = openResultCache(&opts, argc, argv, &rc);
+  if (cached && result_cache_replay(&rc)) {
+    result_cache_close(&rc);
+    return 0;
+  }
+  if (cached) {
+    result_cache_capture(&rc);
+  }
+
+  if (opts.batch_file_name) {
+    runBatch(&opts);
+  } else if (opts.socket_name) {
+    serve(&opts);
+  } else if (opts.num_traces > 1) {
+    simulateShared(&opts);
+  } else if (opts.opt) {
+    simulateOpt(&opts);
+  } else {
+    simulate(&opts);
+  }
+
+  if (cached && summarized) {
+    result_cache_store(&rc, summary.hits, summary.misses, summary.evictions);
+  }
+  if (cached) {
+    result_cache_close(&rc);
+  }
+  return 0;
+}
+
+/*
+ * parseOptions - Parse and check the command line, printing what is wrong
+ * with it.
+ */
+bool parseOptions(int argc, char *argv[], sim_options *opts) {
+  memset(opts, 0, sizeof(*opts));
+  opts->ring_depth = TRACE_DEFAULT_RING_DEPTH;
+  opts->timing_model.hit_latency = 4;
+  opts->timing_model.memory_latency = 100;
+  opts->timing_model.memory_bandwidth = 8;
+  opts->timing_model.overlap = 1;
+  opts->window = 100000;
+  opts->quantum = 1;
+  opts->top = 10;
 
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "-h") == 0) {
       printHelp(argv[0]);
-      return 0;
+      exit(0);
     } else if (strcmp(argv[i], "-v") == 0) {
-      verbose = true;
+      opts->verbose = true;
     } else if (strcmp(argv[i], "-s") == 0) {
       if (++i == argc) {
         printf("%s: option requires an argument -- 's'\n", argv[0]);
-        return 1;
+        return false;
       }
-      num_set_bits = atoi(argv[i]);
+      opts->cache.num_set_bits = atoi(argv[i]);
     } else if (strcmp(argv[i], "-E") == 0) {
       if (++i == argc) {
         printf("%s: option requires an argument -- 'E'\n", argv[0]);
         printHelp(argv[0]);
-        return 1;
+        return false;
       }
-      associativity = atoi(argv[i]);
+      opts->cache.associativity = atoi(argv[i]);
     } else if (strcmp(argv[i], "-b") == 0) {
       if (++i == argc) {
         printf("%s: option requires an argument -- 'b'\n", argv[0]);
-        return 1;
+        return false;
       }
-      num_block_bits = atoi(argv[i]);
+      opts->cache.num_block_bits = atoi(argv[i]);
+    } else if (strcmp(argv[i], "--event-log") == 0) {
+      if (++i == argc) {
+        printf("%s: option requires an argument -- 'event-log'\n", argv[0]);
+        return false;
+      }
+      opts->event_file_name = argv[i];
     } else if (strcmp(argv[i], "-t") == 0) {
       if (++i == argc) {
         printf("%s: option requires an argument -- 't'\n", argv[0]);
-        return 1;
+        return false;
+      }
+      if (opts->num_traces == MAX_TENANTS) {
+        printf("%s: At most %d traces\n", argv[0], MAX_TENANTS);
+        return false;
+      }
+      opts->trace_file_names[opts->num_traces++] = argv[i];
+    } else if (strcmp(argv[i], "-S") == 0) {
+      if (++i == argc || !parseCount(argv[i], &opts->cache.num_sets)) {
+        printf("%s: option requires a count -- 'S'\n", argv[0]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--index") == 0) {
+      if (++i == argc || !parseIndex(argv[i], &opts->cache.index)) {
+        printf("%s: --index takes bits, xor, prime or skewed\n", argv[0]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--sub-blocks") == 0) {
+      uint64_t sub_blocks;
+      if (++i == argc || !parseCount(argv[i], &sub_blocks) ||
+          sub_blocks == 0 || sub_blocks > 64 ||
+          (sub_blocks & (sub_blocks - 1)) != 0) {
+        printf("%s: --sub-blocks takes a power of two up to 64\n", argv[0]);
+        return false;
+      }
+      while (1UL << opts->cache.sub_block_bits < sub_blocks) {
+        opts->cache.sub_block_bits++;
+      }
+    } else if (strcmp(argv[i], "--victim-cache") == 0 ||
+               strcmp(argv[i], "--miss-cache") == 0) {
+      opts->victim = argv[i][2] == 'v' ? VICTIM_CACHE : MISS_CACHE;
+      if (++i == argc || !parseEntries(argv[i], &opts->victim_entries)) {
+        printf("%s: %s takes 1 to %d entries\n", argv[0], argv[i - 1],
+               VICTIM_MAX_ENTRIES);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--level") == 0) {
+      if (++i == argc || opts->num_levels == HIERARCHY_MAX_LEVELS ||
+          !parseLevel(argv[i], &opts->levels[opts->num_levels++])) {
+        printf("%s: --level takes s:E:b:latency, up to %d times\n", argv[0],
+               HIERARCHY_MAX_LEVELS);
+        return false;
+      }
+      opts->timing = true;
+    } else if (strcmp(argv[i], "--timing") == 0) {
+      opts->timing = true;
+    } else if (strcmp(argv[i], "--pipeline") == 0) {
+      opts->pipeline = true;
+    } else if (strcmp(argv[i], "--hit-latency") == 0 ||
+               strcmp(argv[i], "--mem-latency") == 0 ||
+               strcmp(argv[i], "--writeback-cost") == 0) {
+      uint64_t cycles;
+      if (++i == argc || !parseCount(argv[i], &cycles)) {
+        printf("%s: option requires a count -- '%s'\n", argv[0],
+               argv[i - 1] + 2);
+        return false;
+      }
+      if (argv[i - 1][2] == 'h') {
+        opts->timing_model.hit_latency = cycles;
+      } else if (argv[i - 1][2] == 'm') {
+        opts->timing_model.memory_latency = cycles;
+      } else {
+        opts->timing_model.writeback_cost = cycles;
+      }
+      opts->timing = true;
+    } else if (strcmp(argv[i], "--mem-bandwidth") == 0) {
+      if (++i == argc ||
+          !parseRate(argv[i], &opts->timing_model.memory_bandwidth)) {
+        printf("%s: --mem-bandwidth takes bytes per cycle\n", argv[0]);
+        return false;
+      }
+      opts->timing = true;
+    } else if (strcmp(argv[i], "--overlap") == 0) {
+      if (++i == argc || !parseRate(argv[i], &opts->timing_model.overlap) ||
+          opts->timing_model.overlap < 1) {
+        printf("%s: --overlap takes the misses in flight, at least 1\n",
+               argv[0]);
+        return false;
+      }
+      opts->timing = true;
+    } else if (strcmp(argv[i], "--sketch") == 0) {
+      opts->sketch = true;
+    } else if (strcmp(argv[i], "--window") == 0) {
+      if (++i == argc || !parseCount(argv[i], &opts->window) ||
+          opts->window == 0) {
+        printf("%s: option requires a count -- 'window'\n", argv[0]);
+        return false;
+      }
+      opts->sketch = true;
+    } else if (strcmp(argv[i], "--top") == 0) {
+      uint64_t top;
+      if (++i == argc || !parseCount(argv[i], &top) || top == 0 ||
+          top > SKETCH_MAX_TOP) {
+        printf("%s: --top takes 1 to %d\n", argv[0], SKETCH_MAX_TOP);
+        return false;
+      }
+      opts->top = top;
+      opts->sketch = true;
+    } else if (strcmp(argv[i], "--regions") == 0) {
+      if (++i == argc) {
+        printf("%s: option requires an argument -- 'regions'\n", argv[0]);
+        return false;
+      }
+      opts->region_file_name = argv[i];
+    } else if (strcmp(argv[i], "--paging") == 0) {
+      if (++i == argc || !parsePaging(argv[i], &opts->paging)) {
+        printf("%s: --paging takes sequential, random, color:<num> or "
+               "huge\n",
+               argv[0]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--paging-seed") == 0) {
+      if (++i == argc || !parseCount(argv[i], &opts->paging.seed)) {
+        printf("%s: option requires a count -- 'paging-seed'\n", argv[0]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--cos") == 0) {
+      if (opts->num_cos == PARTITION_MAX_CLASSES) {
+        printf("%s: At most %d classes of service\n", argv[0],
+               PARTITION_MAX_CLASSES);
+        return false;
+      }
+      if (++i == argc ||
+          !parseClass(argv[i], &opts->cos_targets[opts->num_cos],
+                      &opts->cos_ways[opts->num_cos])) {
+        printf("%s: --cos takes <region or trace>:<way mask in hex>\n",
+               argv[0]);
+        return false;
+      }
+      opts->num_cos++;
+    } else if (strcmp(argv[i], "--occupancy") == 0) {
+      if (++i == argc || !parseCount(argv[i], &opts->occupancy) ||
+          opts->occupancy == 0) {
+        printf("%s: option requires a count -- 'occupancy'\n", argv[0]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--private-l1") == 0) {
+      if (++i == argc || !parseGeometry(argv[i], &opts->private_l1)) {
+        printf("%s: --private-l1 takes s:E:b\n", argv[0]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--icache") == 0) {
+      if (++i == argc || !parseGeometry(argv[i], &opts->icache)) {
+        printf("%s: --icache takes s:E:b\n", argv[0]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--quantum") == 0) {
+      if (++i == argc || !parseCount(argv[i], &opts->quantum) ||
+          opts->quantum == 0) {
+        printf("%s: option requires a count -- 'quantum'\n", argv[0]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--batch") == 0) {
+      if (++i == argc) {
+        printf("%s: option requires an argument -- 'batch'\n", argv[0]);
+        return false;
+      }
+      opts->batch_file_name = argv[i];
+    } else if (strcmp(argv[i], "--serve") == 0) {
+      if (++i == argc) {
+        printf("%s: option requires an argument -- 'serve'\n", argv[0]);
+        return false;
+      }
+      opts->socket_name = argv[i];
+    } else if (strcmp(argv[i], "--threads") == 0) {
+      uint64_t threads;
+      if (++i == argc || !parseCount(argv[i], &threads) || threads == 0 ||
+          threads > 1024) {
+        printf("%s: --threads takes 1 to 1024\n", argv[0]);
+        return false;
+      }
+      opts->threads = threads;
+    } else if (strcmp(argv[i], "--result-cache") == 0) {
+      if (++i == argc) {
+        printf("%s: option requires an argument -- 'result-cache'\n",
+               argv[0]);
+        return false;
+      }
+      opts->result_cache_dir = argv[i];
+    } else if (strcmp(argv[i], "--opt") == 0) {
+      opts->opt = true;
+    } else if (strcmp(argv[i], "--compact") == 0) {
+      opts->cache.compact = true;
+    } else if (strcmp(argv[i], "--ring-depth") == 0) {
+      uint64_t depth;
+      if (++i == argc || !parseCount(argv[i], &depth)) {
+        printf("%s: option requires a count -- 'ring-depth'\n", argv[0]);
+        return false;
+      }
+      opts->ring_depth = depth;
+    } else if (strcmp(argv[i], "--checkpoint") == 0) {
+      if (++i == argc) {
+        printf("%s: option requires an argument -- 'checkpoint'\n", argv[0]);
+        return false;
+      }
+      opts->checkpoint_file_name = argv[i];
+    } else if (strcmp(argv[i], "--checkpoint-at") == 0) {
+      if (++i == argc || !parseCount(argv[i], &opts->checkpoint_at)) {
+        printf("%s: option requires a count -- 'checkpoint-at'\n", argv[0]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--resume") == 0) {
+      if (++i == argc) {
+        printf("%s: option requires an argument -- 'resume'\n", argv[0]);
+        return false;
+      }
+      opts->resume_file_name = argv[i];
+    } else if (strcmp(argv[i], "--warm") == 0) {
+      if (++i == argc) {
+        printf("%s: option requires an argument -- 'warm'\n", argv[0]);
+        return false;
+      }
+      opts->warm_file_name = argv[i];
+    } else if (strcmp(argv[i], "--warmup") == 0) {
+      if (++i == argc || !parseCount(argv[i], &opts->warmup)) {
+        printf("%s: option requires a count -- 'warmup'\n", argv[0]);
+        return false;
       }
-      trace_file_name = argv[i];
     }
   }
 
-  if (num_set_bits <= 0 || num_block_bits <= 0 || associativity <= 0 ||
-      trace_file_name == NULL) {
+  if (opts->threads == 0) {
+    opts->threads = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (!opts->result_cache_dir && getenv("CSIM_RESULT_CACHE") &&
+      *getenv("CSIM_RESULT_CACHE")) {
+    opts->result_cache_dir = getenv("CSIM_RESULT_CACHE");
+  }
+  if (opts->batch_file_name) {
+    /* Everything else is given per job. */
+    return true;
+  }
+  if (opts->socket_name) {
+    /* Everything but the trace is given per request. */
+    if (opts->num_traces != 1) {
+      printf("%s: --serve takes one trace\n", argv[0]);
+      return false;
+    }
+    return true;
+  }
+  if (opts->cache.num_sets > 0 && opts->cache.num_set_bits <= 0) {
+    while (1UL << opts->cache.num_set_bits < opts->cache.num_sets) {
+      opts->cache.num_set_bits++;
+    }
+  }
+  if ((opts->cache.num_set_bits <= 0 && opts->cache.num_sets != 1) ||
+      opts->cache.num_block_bits <= 0 || opts->cache.associativity <= 0 ||
+      opts->num_traces == 0) {
     printf("%s: Missing required command line argument\n", argv[0]);
     printHelp(argv[0]);
-    return 1;
+    return false;
+  }
+  if (opts->cache.index == INDEX_PRIME && opts->cache.num_sets == 0) {
+    opts->cache.num_sets = largestPrime(1UL << opts->cache.num_set_bits);
+  }
+  if (opts->cache.num_sets > 0 &&
+      opts->cache.num_sets != 1UL << opts->cache.num_set_bits &&
+      (opts->cache.index == INDEX_BITS || opts->cache.index == INDEX_XOR)) {
+    printf("%s: %lu sets need --index prime or skewed\n", argv[0],
+           opts->cache.num_sets);
+    return false;
+  }
+  if (opts->cache.sub_block_bits > opts->cache.num_block_bits) {
+    printf("%s: Sub-blocks smaller than a byte\n", argv[0]);
+    return false;
+  }
+  if (opts->victim != VICTIM_NONE && opts->cache.sub_block_bits) {
+    printf("%s: Sector caches cannot have a victim or miss cache\n",
+           argv[0]);
+    return false;
   }
+  if (opts->cache.index == INDEX_SKEWED &&
+      (opts->checkpoint_file_name || opts->resume_file_name ||
+       opts->warm_file_name)) {
+    printf("%s: Skewed caches cannot be checkpointed\n", argv[0]);
+    return false;
+  }
+  if (opts->opt &&
+      (opts->cache.index == INDEX_SKEWED || opts->cache.sub_block_bits ||
+       opts->victim != VICTIM_NONE || opts->checkpoint_file_name ||
+       opts->resume_file_name || opts->warm_file_name)) {
+    printf("%s: --opt only simulates plain caches from the start of the "
+           "trace\n",
+           argv[0]);
+    return false;
+  }
+  if (opts->opt && opts->paging.policy != PAGING_NONE &&
+      opts->cache.num_block_bits >
+          (opts->paging.policy == PAGING_HUGE ? HUGE_PAGE_BITS : PAGE_BITS)) {
+    printf("%s: --opt with --paging needs blocks no larger than a page\n",
+           argv[0]);
+    return false;
+  }
+  if (opts->paging.policy != PAGING_NONE &&
+      (opts->num_traces > 1 || opts->region_file_name ||
+       opts->checkpoint_file_name || opts->resume_file_name ||
+       opts->warm_file_name)) {
+    printf("%s: --paging only works with one trace, without --regions and "
+           "snapshots\n",
+           argv[0]);
+    return false;
+  }
+  if (opts->num_cos) {
+    int assoc = opts->cache.associativity;
+    if (opts->opt || opts->cache.compact ||
+        assoc > CACHE_MAX_PARTITIONED_ASSOCIATIVITY ||
+        opts->checkpoint_file_name || opts->resume_file_name ||
+        opts->warm_file_name ||
+        (opts->num_traces == 1 && !opts->region_file_name)) {
+      printf("%s: --cos needs --regions or several traces, and a cache "
+             "without --opt, --compact,\nsnapshots or more than %d "
+             "lines per set\n",
+             argv[0], CACHE_MAX_PARTITIONED_ASSOCIATIVITY);
+      return false;
+    }
+    for (int i = 0; i < opts->num_cos; i++) {
+      if (assoc < 64 && opts->cos_ways[i] >> assoc) {
+        printf("%s: Way mask %lx is wider than %d lines per set\n",
+               argv[0], opts->cos_ways[i], assoc);
+        return false;
+      }
+    }
+  } else if (opts->occupancy) {
+    printf("%s: --occupancy needs --cos\n", argv[0]);
+    return false;
+  }
+  if (opts->region_file_name && (opts->opt || opts->num_traces > 1)) {
+    printf("%s: --regions only works with one trace, without --opt\n",
+           argv[0]);
+    return false;
+  }
+  if (opts->icache.associativity &&
+      (opts->opt || opts->num_traces > 1 || opts->checkpoint_file_name ||
+       opts->resume_file_name || opts->warm_file_name)) {
+    printf("%s: --icache only works with one trace, without --opt and "
+           "snapshots\n",
+           argv[0]);
+    return false;
+  }
+  opts->icache.compact = opts->cache.compact;
+  for (int i = 0; i < opts->num_levels; i++) {
+    int above = i ? opts->levels[i - 1].cache.num_block_bits
+                  : opts->cache.num_block_bits;
+    if (i == 0 && opts->icache.num_block_bits > above) {
+      above = opts->icache.num_block_bits;
+    }
+    if (opts->levels[i].cache.num_block_bits < above) {
+      printf("%s: Level %d has smaller blocks than the level above\n",
+             argv[0], i + 2);
+      return false;
+    }
+    opts->levels[i].cache.compact = opts->cache.compact;
+  }
+  if (opts->pipeline && !opts->num_levels) {
+    printf("%s: --pipeline needs --level\n", argv[0]);
+    return false;
+  }
+  if (opts->num_levels && (opts->checkpoint_file_name ||
+                          opts->resume_file_name || opts->warm_file_name)) {
+    printf("%s: Caches with --level cannot be checkpointed\n", argv[0]);
+    return false;
+  }
+  if (opts->num_traces > 1) {
+    if (opts->opt || opts->victim != VICTIM_NONE || opts->num_levels ||
+        opts->timing || opts->sketch || opts->warmup ||
+        opts->checkpoint_file_name || opts->resume_file_name ||
+        opts->warm_file_name) {
+      printf("%s: Several traces only share a plain cache\n", argv[0]);
+      return false;
+    }
+    if (opts->private_l1.associativity &&
+        opts->private_l1.num_block_bits > opts->cache.num_block_bits) {
+      printf("%s: Private L1s have larger blocks than the shared cache\n",
+             argv[0]);
+      return false;
+    }
+    opts->cache.address_bits = CACHE_ADDRESS_BITS + TENANT_BITS;
+    opts->private_l1.address_bits = opts->cache.address_bits;
+    opts->private_l1.compact = opts->cache.compact;
+  } else if (opts->private_l1.associativity) {
+    printf("%s: --private-l1 needs several traces\n", argv[0]);
+    return false;
+  }
+  if (opts->checkpoint_at && !opts->checkpoint_file_name) {
+    printf("%s: --checkpoint-at requires --checkpoint\n", argv[0]);
+    return false;
+  }
+  if (opts->resume_file_name && opts->warm_file_name) {
+    printf("%s: --resume and --warm are mutually exclusive\n", argv[0]);
+    return false;
+  }
+  return true;
+}
 
-  simulate(num_set_bits, num_block_bits, associativity, trace_file_name,
-           verbose);
+void simulate(const sim_options *opts) {
+  cache c;
+  cache_initialize(&c, &opts->cache);
+  victim_buffer victims;
+  if (opts->victim != VICTIM_NONE) {
+    victim_initialize(&victims, opts->victim, opts->victim_entries,
+                      c.num_block_bits);
+  } else {
+    memset(&victims, 0, sizeof(victims));
+  }
+  hierarchy h;
+  hierarchy_initialize(&h, opts->levels, opts->num_levels,
+                       &opts->timing_model);
+  if (opts->pipeline) {
+    hierarchy_start(&h);
+  }
+  sim_sketches *sketches = newSketches(opts);
+  region_map *regions = NULL;
+  if (opts->region_file_name) {
+    regions = malloc(sizeof(region_map));
+    if (!regions) {
+      printf("malloc failed");
+      exit(1);
+    }
+    if (!region_map_load(regions, opts->region_file_name)) {
+      printf("Unable to read region map: %s.\n", opts->region_file_name);
+      exit(1);
+    }
+  }
+  int region_classes[REGION_MAX + 1];
+  partition *part = newPartition(opts, &c, regions, region_classes);
+  uint64_t next_occupancy = opts->occupancy;
+  bool paging = opts->paging.policy != PAGING_NONE;
+  page_table pages;
+  if (paging) {
+    paging_initialize(&pages, &opts->paging);
+  }
+  bool split = opts->icache.associativity > 0;
+  cache icache;
+  sim_stats istats;
+  memset(&istats, 0, sizeof(istats));
+  if (split) {
+    cache_initialize(&icache, &opts->icache);
+  }
 
-  return 0;
+  sim_stats stats;
+  snapshot_header header;
+  memset(&stats, 0, sizeof(stats));
+  memset(&header, 0, sizeof(header));
+  if (opts->resume_file_name) {
+    readSnapshot(opts->resume_file_name, &c, &victims, &stats, &header);
+  } else if (opts->warm_file_name) {
+    readSnapshot(opts->warm_file_name, &c, &victims, NULL, NULL);
+  }
+
+  trace_reader trace;
+  if (!trace_open(&trace, opts->trace_file_names[0], opts->ring_depth,
+                  header.trace_offset, split)) {
+    printf("Unable to open trace file: %s.\n", opts->trace_file_names[0]);
+    exit(1);
+  }
+  mem_access skipped;
+  for (uint64_t i = 0; i < header.trace_skip; i++) {
+    if (!trace_next(&trace, &skipped)) {
+      printf("Trace file %s is shorter than the snapshot.\n",
+             opts->trace_file_names[0]);
+      exit(1);
+    }
+  }
+
+  access_filter filter = {
+      .trace = &trace,
+      .run_bits = c.num_block_bits - c.sub_block_bits,
+      .coalesce = !opts->verbose && !opts->event_file_name,
+      .has_next = false,
+      .accesses = header.accesses,
+  };
+  if (split && icache.num_block_bits < filter.run_bits) {
+    filter.run_bits = icache.num_block_bits;
+  }
+  /* A line larger than a page spans frames that are not adjacent. */
+  if (paging && pages.page_bits < filter.run_bits) {
+    filter.run_bits = pages.page_bits;
+  }
+  filter.barrier = nextBarrier(opts, filter.accesses);
+  if (sketches) {
+    sketches->window_start = filter.accesses;
+  }
+
+  if (opts->checkpoint_file_name) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = checkpointHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(SIGUSR1, &action, NULL) < 0) {
+      printf("Unable to install SIGUSR1 handler\n");
+      exit(1);
+    }
+  }
+
+  access_log log;
+  access_log_open(&log, opts->verbose, opts->event_file_name, &opts->cache);
+  access_run run;
+  cache_result result;
+  cache_update update;
+  victim_result victim;
+  PROF_START();
+  while (nextRun(&filter, &run)) {
+    victim = VICTIM_MISS;
+    /* A run stays within a line and within a page. */
+    uint64_t address = paging ? paging_translate(&pages, run.access.address)
+                              : run.access.address;
+    if (run.access.mode == INST) {
+      result = cache_access(&icache, address, false, &update);
+      chargeMemory(&h, icache.num_block_bits, address, &update, &istats);
+      countAccess(&istats, &run.access, result, &update);
+      istats.hits += run.repeat_hits;
+    } else {
+      bool write = run.access.mode != LOAD || run.repeat_writes;
+      int cls = 0;
+      if (part) {
+        cls = region_classes[region_find(regions, run.access.address)];
+        result = cache_access_ways(&c, address, write,
+                                   part->classes[cls].ways, &update);
+      } else {
+        result = cache_access(&c, address, write, &update);
+      }
+      if (victims.kind != VICTIM_NONE) {
+        victim = victim_access(&victims, &c, result, &update);
+        stats.victim_hits += victim != VICTIM_MISS;
+        stats.victim_swaps += victim == VICTIM_SWAP;
+      }
+      chargeMemory(&h, c.num_block_bits, address, &update, &stats);
+      countAccess(&stats, &run.access, result, &update);
+      stats.hits += run.repeat_hits;
+      if (sketches) {
+        sketchAccess(sketches, result, &update);
+      }
+      if (regions) {
+        region_access(regions, &run.access, run.repeat_hits, result, &update,
+                      c.num_block_bits);
+      }
+      if (part) {
+        partition_access(part, cls, &run.access, run.repeat_hits, result,
+                         &update);
+      }
+    }
+    if (log.active) {
+      access_log_write(&log, &run.access, -1, result, victim, &update);
+    }
+    if (part && opts->occupancy) {
+      reportOccupancy(opts, part, filter.accesses, &next_occupancy);
+    }
+
+    if (filter.accesses == filter.barrier) {
+      if (filter.accesses == opts->warmup) {
+        memset(&stats, 0, sizeof(stats));
+        memset(&istats, 0, sizeof(istats));
+        hierarchy_reset_stats(&h);
+        if (regions) {
+          region_reset_stats(regions);
+        }
+        if (part) {
+          partition_reset_stats(part);
+        }
+        if (sketches) {
+          count_min_initialize(&sketches->missed_lines, opts->top);
+          count_min_initialize(&sketches->evicted_sets, opts->top);
+        }
+      }
+      if (sketches && filter.accesses % opts->window == 0) {
+        access_log_flush(&log);
+        closeWindow(sketches, filter.accesses);
+      }
+      if (filter.accesses == opts->checkpoint_at) {
+        writeSnapshot(opts->checkpoint_file_name, &c, &victims, &stats,
+                      &filter);
+      }
+      filter.barrier = nextBarrier(opts, filter.accesses);
+    }
+    if (checkpoint_requested) {
+      checkpoint_requested = 0;
+      writeSnapshot(opts->checkpoint_file_name, &c, &victims, &stats,
+                      &filter);
+    }
+  }
+  trace_close(&trace);
+  access_log_close(&log);
+  hierarchy_finish(&h, &stats.miss_cycles, &stats.writeback_cycles);
+  checkPaging(paging && pages.full);
+  if (sketches) {
+    closeWindow(sketches, filter.accesses);
+  }
+  summarize(stats.hits, stats.misses, stats.evictions);
+  printBuffers(stdout, opts, &stats);
+  if (part) {
+    partition_print(part);
+    partition_destroy(part);
+    free(part);
+  }
+  if (regions) {
+    region_print(regions);
+    free(regions);
+  }
+  if (paging) {
+    printPaging(stdout, opts, pages.size);
+    paging_destroy(&pages);
+  }
+  if (split) {
+    printf("I-cache hits:%d misses:%d evictions:%d\n", istats.hits,
+           istats.misses, istats.evictions);
+    stats.hits += istats.hits;
+    stats.misses += istats.misses;
+    stats.miss_cycles += istats.miss_cycles;
+    stats.writeback_cycles += istats.writeback_cycles;
+    cache_destroy(&icache);
+  }
+  printTiming(stdout, opts, h.stats, &stats);
+  if (sketches) {
+    printSketches(sketches, c.num_block_bits);
+    free(sketches);
+  }
+  PROF_REPORT(filter.accesses);
+  if (victims.kind != VICTIM_NONE) {
+    victim_destroy(&victims);
+  }
+  hierarchy_destroy(&h);
+  cache_destroy(&c);
+}
+
+/*
+ * simulateOpt - Simulate the trace with Belady's optimal replacement. The
+ * trace is read in full first, the next uses are only known at its end.
+ */
+void simulateOpt(const sim_options *opts) {
+  cache c;
+  cache_initialize(&c, &opts->cache);
+  trace_reader trace;
+  if (!trace_open(&trace, opts->trace_file_names[0], opts->ring_depth, 0,
+                  false)) {
+    printf("Unable to open trace file: %s.\n", opts->trace_file_names[0]);
+    exit(1);
+  }
+  opt_trace t;
+  if (!opt_trace_load(&t, &trace, c.num_block_bits)) {
+    printf("Unable to pack trace file: %s.\n", opts->trace_file_names[0]);
+    exit(1);
+  }
+  trace_close(&trace);
+
+  opt_cache o;
+  opt_initialize(&o, &c);
+  hierarchy h;
+  hierarchy_initialize(&h, opts->levels, opts->num_levels,
+                       &opts->timing_model);
+  if (opts->pipeline) {
+    hierarchy_start(&h);
+  }
+  sim_sketches *sketches = newSketches(opts);
+  sim_stats stats;
+  memset(&stats, 0, sizeof(stats));
+  /* Pages map blocks one to one, parseOptions() makes sure no block spans
+     pages, so the next uses stay valid. */
+  bool paging = opts->paging.policy != PAGING_NONE;
+  page_table pages;
+  if (paging) {
+    paging_initialize(&pages, &opts->paging);
+  }
+  access_log log;
+  access_log_open(&log, opts->verbose, opts->event_file_name, &opts->cache);
+  cache_result result;
+  cache_update update;
+  PROF_START();
+  for (uint64_t i = 0; i < t.packed.count; i++) {
+    const mem_access *access = t.packed.accesses + i;
+    uint64_t address = paging ? paging_translate(&pages, access->address)
+                              : access->address;
+    result = opt_access(&o, address, t.next_use[i], access->mode != LOAD,
+                        &update);
+    countAccess(&stats, access, result, &update);
+    if (log.active) {
+      access_log_write(&log, access, -1, result, VICTIM_MISS, &update);
+    }
+    chargeMemory(&h, c.num_block_bits, address, &update, &stats);
+    if (sketches) {
+      sketchAccess(sketches, result, &update);
+    }
+    if (i + 1 == opts->warmup) {
+      memset(&stats, 0, sizeof(stats));
+      hierarchy_reset_stats(&h);
+      if (sketches) {
+        count_min_initialize(&sketches->missed_lines, opts->top);
+        count_min_initialize(&sketches->evicted_sets, opts->top);
+      }
+    }
+    if (sketches && (i + 1) % opts->window == 0) {
+      access_log_flush(&log);
+      closeWindow(sketches, i + 1);
+    }
+  }
+  access_log_close(&log);
+  hierarchy_finish(&h, &stats.miss_cycles, &stats.writeback_cycles);
+  checkPaging(paging && pages.full);
+  if (sketches) {
+    closeWindow(sketches, t.packed.count);
+  }
+  summarize(stats.hits, stats.misses, stats.evictions);
+  if (paging) {
+    printPaging(stdout, opts, pages.size);
+    paging_destroy(&pages);
+  }
+  printTiming(stdout, opts, h.stats, &stats);
+  if (sketches) {
+    printSketches(sketches, c.num_block_bits);
+    free(sketches);
+  }
+  PROF_REPORT(t.packed.count);
+  hierarchy_destroy(&h);
+  opt_destroy(&o);
+  opt_trace_unload(&t);
+  cache_destroy(&c);
 }
 
-void simulate(int num_set_bits, int num_block_bits, int associativity,
-              char *trace_file_name, bool verbose) {
-  int num_sets = 1 << num_set_bits;
-  cache_set *cache_sets = malloc(num_sets * sizeof(cache_set));
-  if (!cache_sets) {
+/*
+ * simulateShared - Interleave several traces in one cache, each running
+ * quantum accesses at a time. Runs never cross the end of a quantum, so
+ * coalescing them does not change the interleaving. The address of every
+ * access is tagged with its trace above CACHE_ADDRESS_BITS.
+ */
+void simulateShared(const sim_options *opts) {
+  cache shared;
+  cache_initialize(&shared, &opts->cache);
+  int num_tenants = opts->num_traces;
+  tenant *tenants = calloc(num_tenants, sizeof(tenant));
+  if (!tenants) {
     printf("malloc failed");
     exit(1);
   }
-  for (int i = 0; i < num_sets; i++) {
-    cache_sets[i].lines = malloc(associativity * sizeof(cache_line));
-    if (!cache_sets[i].lines) {
-      printf("malloc failed");
+  for (int t = 0; t < num_tenants; t++) {
+    if (!trace_open(&tenants[t].trace, opts->trace_file_names[t],
+                    opts->ring_depth, 0, false)) {
+      printf("Unable to open trace file: %s.\n", opts->trace_file_names[t]);
       exit(1);
     }
-    linked_list_initialize(&cache_sets[i].ll, offsetof(cache_line, ll_node));
-    splay_tree_initialize(&cache_sets[i].st, offsetof(cache_line, st_node),
-                          cache_line_cmp);
+    if (opts->private_l1.associativity) {
+      cache_initialize(&tenants[t].l1, &opts->private_l1);
+    }
+    tenants[t].filter.trace = &tenants[t].trace;
+    tenants[t].filter.run_bits = opts->private_l1.associativity
+                                     ? opts->private_l1.num_block_bits
+                                     : shared.num_block_bits -
+                                           shared.sub_block_bits;
+    tenants[t].filter.coalesce = !opts->verbose && !opts->event_file_name;
+  }
+  /* newPartition() fills a slot past the traces, see there. */
+  int trace_classes[MAX_TENANTS + 1];
+  partition *part = newPartition(opts, &shared, NULL, trace_classes);
+  for (int t = 0; t < num_tenants; t++) {
+    tenants[t].cos = trace_classes[t];
   }
+  uint64_t accesses = 0;
+  uint64_t next_occupancy = opts->occupancy;
 
-  FILE *trace_file = fopen(trace_file_name, "r");
-  if (!trace_file) {
-    printf("Unable to open trace file: %s.\n", trace_file_name);
+  access_log log;
+  access_log_open(&log, opts->verbose, opts->event_file_name, &opts->cache);
+  access_run run;
+  cache_result result;
+  cache_update update;
+  PROF_START();
+  for (int active = num_tenants; active > 0;) {
+    for (int t = 0; t < num_tenants; t++) {
+      tenant *tn = &tenants[t];
+      if (tn->done) {
+        continue;
+      }
+      tn->filter.barrier = tn->filter.accesses + opts->quantum;
+      while (tn->filter.accesses != tn->filter.barrier) {
+        uint64_t start = tn->filter.accesses;
+        if (part && opts->occupancy) {
+          reportOccupancy(opts, part, accesses, &next_occupancy);
+        }
+        if (!nextRun(&tn->filter, &run)) {
+          tn->done = true;
+          active--;
+          break;
+        }
+        accesses += tn->filter.accesses - start;
+        if (run.access.address >> CACHE_ADDRESS_BITS) {
+          printf("Address %lx of %s leaves no room for a trace tag.\n",
+                 run.access.address, opts->trace_file_names[t]);
+          exit(1);
+        }
+        uint64_t address =
+            run.access.address | (uint64_t)t << CACHE_ADDRESS_BITS;
+        bool write = run.access.mode != LOAD || run.repeat_writes;
+        if (!opts->private_l1.associativity) {
+          sharedAccess(&shared, tenants, t, part, address, write, &result,
+                       &update);
+          countAccess(&tn->stats, &run.access, result, &update);
+          tn->stats.hits += run.repeat_hits;
+          if (part) {
+            partition_access(part, tn->cos, &run.access, run.repeat_hits,
+                             result, &update);
+          }
+          if (log.active) {
+            access_log_write(&log, &run.access, t, result, VICTIM_MISS,
+                             &update);
+          }
+          continue;
+        }
+        cache_update l1_update;
+        cache_result l1_result =
+            cache_access(&tn->l1, address, write, &l1_update);
+        countAccess(&tn->l1_stats, &run.access, l1_result, &l1_update);
+        tn->l1_stats.hits += run.repeat_hits;
+        if (log.active) {
+          access_log_write(&log, &run.access, t, l1_result, VICTIM_MISS,
+                           &l1_update);
+        }
+        if (l1_update.fill_bytes) {
+          sharedAccess(&shared, tenants, t, part, address, false, &result,
+                       &update);
+        }
+        if (l1_update.writeback_bytes) {
+          sharedAccess(&shared, tenants, t, part,
+                       l1_update.writeback_block << tn->l1.num_block_bits,
+                       true, &result, &update);
+        }
+      }
+    }
+  }
+
+  if (part && opts->occupancy) {
+    reportOccupancy(opts, part, accesses, &next_occupancy);
+  }
+  access_log_close(&log);
+  sim_stats total;
+  memset(&total, 0, sizeof(total));
+  for (int t = 0; t < num_tenants; t++) {
+    total.hits += tenants[t].stats.hits;
+    total.misses += tenants[t].stats.misses;
+    total.evictions += tenants[t].stats.evictions;
+  }
+  summarize(total.hits, total.misses, total.evictions);
+  for (int t = 0; t < num_tenants; t++) {
+    tenant *tn = &tenants[t];
+    trace_close(&tn->trace);
+    printf("trace %d %s hits:%d misses:%d evictions:%d "
+           "evicted by others:%lu\n",
+           t, opts->trace_file_names[t], tn->stats.hits, tn->stats.misses,
+           tn->stats.evictions, tn->evicted_by_others);
+    if (opts->private_l1.associativity) {
+      printf("trace %d L1 hits:%d misses:%d evictions:%d\n", t,
+             tn->l1_stats.hits, tn->l1_stats.misses, tn->l1_stats.evictions);
+      cache_destroy(&tn->l1);
+    }
+  }
+  if (part) {
+    partition_print(part);
+    partition_destroy(part);
+    free(part);
+  }
+  PROF_REPORT(accesses);
+  free(tenants);
+  cache_destroy(&shared);
+}
+
+/*
+ * runBatch - Run every job of the job file on a thread pool and print one
+ * table of the results, in the order of the jobs.
+ */
+void runBatch(const sim_options *opts) {
+  batch b;
+  memset(&b, 0, sizeof(b));
+  b.ring_depth = opts->ring_depth;
+  readJobs(opts->batch_file_name, &b);
+  b.traces = calloc(b.num_traces, sizeof(packed_trace));
+  if (!b.traces) {
+    printf("malloc failed");
+    exit(1);
+  }
+  PROF_START();
+  pool_run(b.num_traces, opts->threads, loadTrace, &b);
+  pool_run(b.num_opt_traces, opts->threads, loadOptTrace, &b);
+  pool_run(b.num_jobs, opts->threads, runJob, &b);
+  uint64_t accesses = 0;
+  for (size_t i = 0; i < b.num_jobs; i++) {
+    accesses += b.traces[b.jobs[i].trace].count;
+  }
+  PROF_REPORT(accesses);
+  for (size_t i = 0; i < b.num_jobs; i++) {
+    checkPaging(b.jobs[i].pages_full);
+  }
+
+  int width = strlen("trace");
+  for (size_t i = 0; i < b.num_traces; i++) {
+    if (strlen(b.trace_names[i]) > width) {
+      width = strlen(b.trace_names[i]);
+    }
+  }
+  /* The buffer columns are "-" for jobs without a victim or miss cache. */
+  printf("%5s %-*s %3s %5s %3s %-10s %-6s %-10s %12s %12s %12s %12s %12s\n",
+         "line", width, "trace", "s", "E", "b", "paging", "policy", "buffer",
+         "hits", "misses", "evictions", "buffer-hits", "swaps");
+  for (size_t i = 0; i < b.num_jobs; i++) {
+    const batch_job *job = &b.jobs[i];
+    char paging[16], buffer[24] = "-", buffer_hits[24] = "-", swaps[24] = "-";
+    paging_describe(&job->opts.paging, paging, sizeof(paging));
+    if (job->opts.victim != VICTIM_NONE) {
+      sprintf(buffer, "%s:%d",
+              job->opts.victim == VICTIM_CACHE ? "victim" : "miss",
+              job->opts.victim_entries);
+      sprintf(buffer_hits, "%lu", job->stats.victim_hits);
+    }
+    if (job->opts.victim == VICTIM_CACHE) {
+      sprintf(swaps, "%lu", job->stats.victim_swaps);
+    }
+    printf("%5d %-*s %3d %5d %3d %-10s %-6s %-10s %12d %12d %12d %12s %12s\n",
+           job->line, width, b.trace_names[job->trace],
+           job->opts.cache.num_set_bits, job->opts.cache.associativity,
+           job->opts.cache.num_block_bits, paging,
+           job->opts.opt ? "opt" : "lru", buffer, job->stats.hits,
+           job->stats.misses, job->stats.evictions, buffer_hits, swaps);
+  }
+
+  for (size_t i = 0; i < b.num_opt_traces; i++) {
+    opt_trace_unload(&b.opt_traces[i].t);
+  }
+  free(b.opt_traces);
+  for (size_t i = 0; i < b.num_traces; i++) {
+    trace_unpack(&b.traces[i]);
+    free(b.trace_names[i]);
+  }
+  free(b.traces);
+  free(b.trace_names);
+  free(b.jobs);
+}
+
+/*
+ * readJobs - Read a job file. Every line holds the csim options of one
+ * simulation, and its -t may be a glob that makes a job per matching trace.
+ * Empty lines and lines starting with # are skipped. --opt jobs share the
+ * next uses of their trace with the other jobs of the same block size.
+ */
+void readJobs(const char *file_name, batch *b) {
+  FILE *fp = fopen(file_name, "r");
+  if (!fp) {
+    printf("Unable to open job file: %s.\n", file_name);
     exit(1);
   }
+  char *line = NULL;
+  size_t line_size = 0;
+  size_t jobs_size = 0;
+  size_t opt_traces_size = 0;
+  for (int line_no = 1; getline(&line, &line_size, fp) != -1; line_no++) {
+    char name[strlen(file_name) + 16];
+    char *args[64];
+    int argc = 1;
+    sprintf(name, "%s:%d", file_name, line_no);
+    args[0] = name;
+    for (char *arg = strtok(line, " \t\r\n"); arg;
+         arg = strtok(NULL, " \t\r\n")) {
+      if (argc == sizeof(args) / sizeof(args[0])) {
+        printf("%s: Too many options\n", name);
+        exit(1);
+      }
+      args[argc++] = arg;
+    }
+    if (argc == 1 || args[1][0] == '#') {
+      continue;
+    }
 
-  int hits = 0;
-  int misses = 0;
-  int evictions = 0;
-  mem_access access;
-  cache_set *set;
-  cache_line line, *hit;
-  uint64_t tag;
-  uint64_t set_idx;
-  char buffer[50];
-  while (nextAccess(trace_file, buffer, sizeof(buffer), &access)) {
-    if (verbose) {
-      printf(buffer + 1);
-    }
-    decode(access.address, num_set_bits, num_block_bits, &set_idx, &tag);
-    assert(set_idx < num_sets);
-    set = cache_sets + set_idx;
-    line.tag = tag;
-    hit = splay_tree_search(&set->st, &line);
-    if (hit) {
-      hits++;
-      if (verbose) {
-        printf(" hit");
-      }
-      linked_list_remove(&set->ll, hit);
-      linked_list_push_front(&set->ll, hit);
-      if (access.mode == MODIFY) {
-        hits++;
-        if (verbose) {
-          printf(" hit");
+    sim_options opts;
+    if (!parseOptions(argc, args, &opts)) {
+      exit(1);
+    }
+    if (opts.num_traces != 1 || opts.verbose || opts.event_file_name ||
+        opts.icache.associativity || opts.num_levels ||
+        opts.timing || opts.sketch || opts.region_file_name ||
+        opts.num_cos || opts.checkpoint_file_name ||
+        opts.resume_file_name || opts.warm_file_name ||
+        opts.batch_file_name) {
+      printf("%s: A job simulates one trace in one cache, with a victim "
+             "cache at most\n",
+             name);
+      exit(1);
+    }
+
+    glob_t matches;
+    if (glob(opts.trace_file_names[0], 0, NULL, &matches) != 0) {
+      printf("%s: No trace matches %s\n", name, opts.trace_file_names[0]);
+      exit(1);
+    }
+    for (size_t i = 0; i < matches.gl_pathc; i++) {
+      size_t trace = 0;
+      while (trace < b->num_traces &&
+             strcmp(b->trace_names[trace], matches.gl_pathv[i]) != 0) {
+        trace++;
+      }
+      if (trace == b->num_traces) {
+        b->trace_names =
+            realloc(b->trace_names, (trace + 1) * sizeof(char *));
+        if (!b->trace_names) {
+          printf("malloc failed");
+          exit(1);
         }
+        b->trace_names[b->num_traces++] = strdup(matches.gl_pathv[i]);
       }
-    } else {
-      misses++;
-      if (verbose) {
-        printf(" miss");
-      }
-      assert(set->st.size == set->ll.size);
-      if (set->st.size < associativity) {
-        cache_line *new_line = set->lines + set->st.size;
-        new_line->tag = tag;
-        linked_list_push_front(&set->ll, new_line);
-        assert(splay_tree_insert(&set->st, new_line));
-      } else {
-        cache_line *new_line = (cache_line *)linked_list_pop_back(&set->ll);
-        assert(splay_tree_remove(&set->st, new_line));
-        new_line->tag = tag;
-        linked_list_push_front(&set->ll, new_line);
-        assert(splay_tree_insert(&set->st, new_line));
-        evictions++;
-        if (verbose) {
-          printf(" eviction");
+      if (b->num_jobs == jobs_size) {
+        jobs_size = jobs_size ? 2 * jobs_size : 64;
+        b->jobs = realloc(b->jobs, jobs_size * sizeof(batch_job));
+        if (!b->jobs) {
+          printf("malloc failed");
+          exit(1);
         }
       }
-      if (access.mode == MODIFY) {
-        hits++;
-        if (verbose) {
-          printf(" hit");
+      batch_job *job = &b->jobs[b->num_jobs++];
+      memset(job, 0, sizeof(*job));
+      job->opts = opts;
+      job->line = line_no;
+      job->trace = trace;
+      if (!opts.opt) {
+        continue;
+      }
+      int block_bits = opts.cache.num_block_bits;
+      while (job->opt < b->num_opt_traces &&
+             (b->opt_traces[job->opt].trace != trace ||
+              b->opt_traces[job->opt].num_block_bits != block_bits)) {
+        job->opt++;
+      }
+      if (job->opt == b->num_opt_traces) {
+        if (b->num_opt_traces == opt_traces_size) {
+          opt_traces_size = opt_traces_size ? 2 * opt_traces_size : 16;
+          b->opt_traces =
+              realloc(b->opt_traces, opt_traces_size * sizeof(batch_opt));
+          if (!b->opt_traces) {
+            printf("malloc failed");
+            exit(1);
+          }
         }
+        batch_opt *o = &b->opt_traces[b->num_opt_traces++];
+        o->trace = trace;
+        o->num_block_bits = block_bits;
       }
     }
-    if (verbose) {
-      printf("\n");
+    globfree(&matches);
+  }
+  free(line);
+  fclose(fp);
+}
+
+/*
+ * loadTrace - Pack a trace of the batch.
+ */
+void loadTrace(size_t trace, void *context) {
+  batch *b = context;
+  trace_reader reader;
+  if (!trace_open(&reader, b->trace_names[trace], b->ring_depth, 0, false) ||
+      !trace_pack(&reader, &b->traces[trace])) {
+    printf("Unable to load trace file: %s.\n", b->trace_names[trace]);
+    exit(1);
+  }
+  trace_close(&reader);
+}
+
+/*
+ * loadOptTrace - Pack a trace of the batch with the next uses of its
+ * blocks, for the --opt jobs of one block size.
+ */
+void loadOptTrace(size_t opt, void *context) {
+  batch *b = context;
+  batch_opt *o = &b->opt_traces[opt];
+  trace_reader reader;
+  if (!trace_open(&reader, b->trace_names[o->trace], b->ring_depth, 0,
+                  false) ||
+      !opt_trace_load(&o->t, &reader, o->num_block_bits)) {
+    printf("Unable to pack trace file: %s.\n", b->trace_names[o->trace]);
+    exit(1);
+  }
+  trace_close(&reader);
+}
+
+/*
+ * runJob - Simulate a job of the batch on its packed trace.
+ */
+void runJob(size_t job_idx, void *context) {
+  batch *b = context;
+  batch_job *job = &b->jobs[job_idx];
+  if (job->opts.opt) {
+    simulateOptJob(job, &b->opt_traces[job->opt].t);
+  } else {
+    simulateJob(job, &b->traces[job->trace]);
+  }
+}
+
+/*
+ * simulateJob - Simulate a cache, and the levels below it, on a packed
+ * trace. Runs of accesses to the same line are coalesced as in nextRun(),
+ * and end with the warmup.
+ */
+void simulateJob(batch_job *job, const packed_trace *trace) {
+  const sim_options *opts = &job->opts;
+  cache c;
+  victim_buffer victims;
+  cache_result result;
+  cache_update update;
+
+  cache_initialize(&c, &opts->cache);
+  if (opts->victim != VICTIM_NONE) {
+    victim_initialize(&victims, opts->victim, opts->victim_entries,
+                      c.num_block_bits);
+  }
+  hierarchy h;
+  hierarchy_initialize(&h, opts->levels, opts->num_levels,
+                       &opts->timing_model);
+  if (opts->pipeline) {
+    hierarchy_start(&h);
+  }
+  bool paging = opts->paging.policy != PAGING_NONE;
+  page_table pages;
+  if (paging) {
+    paging_initialize(&pages, &opts->paging);
+  }
+  int run_bits = c.num_block_bits - c.sub_block_bits;
+  if (paging && pages.page_bits < run_bits) {
+    run_bits = pages.page_bits;
+  }
+  uint64_t i = 0;
+  while (i < trace->count) {
+    const mem_access *access = &trace->accesses[i];
+    uint64_t end = i < opts->warmup && opts->warmup < trace->count
+                       ? opts->warmup
+                       : trace->count;
+    /* Bit 63 is not part of the address, see cache_decode(). */
+    uint64_t unit = (access->address << 1) >> (run_bits + 1);
+    bool write = access->mode != LOAD;
+    int repeat_hits = 0;
+    for (i++; i < end &&
+              (trace->accesses[i].address << 1) >> (run_bits + 1) == unit;
+         i++) {
+      repeat_hits += trace->accesses[i].mode == MODIFY ? 2 : 1;
+      write |= trace->accesses[i].mode != LOAD;
+    }
+
+    uint64_t address = paging ? paging_translate(&pages, access->address)
+                              : access->address;
+    result = cache_access(&c, address, write, &update);
+    if (opts->victim != VICTIM_NONE) {
+      victim_result victim = victim_access(&victims, &c, result, &update);
+      job->stats.victim_hits += victim != VICTIM_MISS;
+      job->stats.victim_swaps += victim == VICTIM_SWAP;
+    }
+    chargeMemory(&h, c.num_block_bits, address, &update, &job->stats);
+    countAccess(&job->stats, access, result, &update);
+    job->stats.hits += repeat_hits;
+    if (i == opts->warmup) {
+      memset(&job->stats, 0, sizeof(job->stats));
+      hierarchy_reset_stats(&h);
     }
   }
-  printSummary(hits, misses, evictions);
+
+  hierarchy_finish(&h, &job->stats.miss_cycles,
+                   &job->stats.writeback_cycles);
+  memcpy(job->levels, h.stats, sizeof(job->levels));
+  hierarchy_destroy(&h);
+  if (paging) {
+    job->pages = pages.size;
+    job->pages_full = pages.full;
+    paging_destroy(&pages);
+  }
+  if (opts->victim != VICTIM_NONE) {
+    victim_destroy(&victims);
+  }
+  cache_destroy(&c);
 }
 
-int cache_line_cmp(void *a, void *b) {
-  cache_line *la = (cache_line *)a;
-  cache_line *lb = (cache_line *)b;
-  if (la->tag == lb->tag) {
-    return 0;
-  } else if (la->tag < lb->tag) {
-    return -1;
+/*
+ * simulateOptJob - Simulate Belady's replacement, and the levels below it,
+ * on a trace with the next uses for the block size of the job.
+ */
+void simulateOptJob(batch_job *job, const opt_trace *t) {
+  const sim_options *opts = &job->opts;
+  cache c;
+  cache_initialize(&c, &opts->cache);
+  opt_cache o;
+  opt_initialize(&o, &c);
+  hierarchy h;
+  hierarchy_initialize(&h, opts->levels, opts->num_levels,
+                       &opts->timing_model);
+  if (opts->pipeline) {
+    hierarchy_start(&h);
+  }
+  bool paging = opts->paging.policy != PAGING_NONE;
+  page_table pages;
+  if (paging) {
+    paging_initialize(&pages, &opts->paging);
+  }
+  cache_result result;
+  cache_update update;
+  for (uint64_t i = 0; i < t->packed.count; i++) {
+    const mem_access *access = t->packed.accesses + i;
+    uint64_t address = paging ? paging_translate(&pages, access->address)
+                              : access->address;
+    result = opt_access(&o, address, t->next_use[i], access->mode != LOAD,
+                        &update);
+    countAccess(&job->stats, access, result, &update);
+    chargeMemory(&h, c.num_block_bits, address, &update, &job->stats);
+    if (i + 1 == opts->warmup) {
+      memset(&job->stats, 0, sizeof(job->stats));
+      hierarchy_reset_stats(&h);
+    }
+  }
+
+  hierarchy_finish(&h, &job->stats.miss_cycles,
+                   &job->stats.writeback_cycles);
+  memcpy(job->levels, h.stats, sizeof(job->levels));
+  hierarchy_destroy(&h);
+  if (paging) {
+    job->pages = pages.size;
+    job->pages_full = pages.full;
+    paging_destroy(&pages);
+  }
+  opt_destroy(&o);
+  cache_destroy(&c);
+}
+
+/*
+ * serve - Pack the trace and answer simulation requests on a Unix domain
+ * socket until a client asks the server to shut down.
+ */
+void serve(const sim_options *opts) {
+  server srv;
+  memset(&srv, 0, sizeof(srv));
+  srv.trace_name = opts->trace_file_names[0];
+  srv.ring_depth = opts->ring_depth;
+  pthread_mutex_init(&srv.opt_lock, NULL);
+  trace_reader reader;
+  if (!trace_open(&reader, srv.trace_name, srv.ring_depth, 0, false) ||
+      !trace_pack(&reader, &srv.trace)) {
+    printf("Unable to load trace file: %s.\n", srv.trace_name);
+    exit(1);
+  }
+  trace_close(&reader);
+  for (uint64_t i = 0; i < srv.trace.count; i++) {
+    /* Bit 63 is not part of the address, see cache_decode(). */
+    uint64_t address = srv.trace.accesses[i].address & ~(1UL << 63);
+    if (address > srv.max_address) {
+      srv.max_address = address;
+    }
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(opts->socket_name) >= sizeof(addr.sun_path)) {
+    printf("Socket path too long: %s.\n", opts->socket_name);
+    exit(1);
+  }
+  strcpy(addr.sun_path, opts->socket_name);
+  /* Replace the socket of a server that was killed, but nothing else. */
+  struct stat st;
+  if (stat(opts->socket_name, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(opts->socket_name);
+  }
+  srv.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (srv.listener < 0 ||
+      bind(srv.listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(srv.listener, SOMAXCONN) < 0) {
+    printf("Unable to listen on socket: %s.\n", opts->socket_name);
+    exit(1);
+  }
+  /* A client that hangs up before its reply must not stop the server. */
+  signal(SIGPIPE, SIG_IGN);
+  printf("Serving %s (%lu accesses) on %s, %d connections at a time\n",
+         srv.trace_name, srv.trace.count, opts->socket_name, opts->threads);
+  fflush(stdout);
+
+  pool_run(opts->threads, opts->threads, serveClients, &srv);
+
+  close(srv.listener);
+  unlink(opts->socket_name);
+  for (int i = 0; i < CACHE_ADDRESS_BITS; i++) {
+    if (srv.opt_traces[i]) {
+      opt_trace_unload(srv.opt_traces[i]);
+      free(srv.opt_traces[i]);
+    }
+  }
+  pthread_mutex_destroy(&srv.opt_lock);
+  trace_unpack(&srv.trace);
+}
+
+/*
+ * serveClients - Accept connections and answer their requests in order,
+ * until the server shuts down. Runs on every worker of the pool.
+ */
+void serveClients(size_t worker, void *context) {
+  server *srv = context;
+  while (!srv->stopping) {
+    int fd = accept(srv->listener, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (!srv->stopping) {
+        printf("Unable to accept connection\n");
+      }
+      return;
+    }
+    int out_fd = dup(fd);
+    FILE *in = fdopen(fd, "r");
+    FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+    if (!in || !out) {
+      printf("Unable to open connection\n");
+      exit(1);
+    }
+    char *line = NULL;
+    size_t line_size = 0;
+    bool open = true;
+    while (open && getline(&line, &line_size, in) != -1) {
+      open = serveRequest(srv, line, out);
+      fflush(out);
+    }
+    free(line);
+    fclose(out);
+    fclose(in);
+  }
+}
+
+/*
+ * serveRequest - Answer a line of csim options with the statistics csim
+ * prints for them on the served trace, followed by an empty line. A
+ * request that cannot run gets a line starting with "error:" instead.
+ * "quit" closes the connection and "shutdown" the server. Returns whether
+ * the connection stays open.
+ */
+bool serveRequest(server *srv, char *line, FILE *out) {
+  char *args[64];
+  int argc = 0;
+  char *save;
+  args[argc++] = "request";
+  args[argc++] = "-t";
+  args[argc++] = (char *)srv->trace_name;
+  for (char *arg = strtok_r(line, " \t\r\n", &save); arg;
+       arg = strtok_r(NULL, " \t\r\n", &save)) {
+    if (argc == sizeof(args) / sizeof(args[0])) {
+      fprintf(out, "error: Too many options\n\n");
+      return true;
+    }
+    if (strcmp(arg, "-h") == 0) {
+      fprintf(out, "error: See csim -h for the options\n\n");
+      return true;
+    }
+    args[argc++] = arg;
+  }
+  if (argc == 3 || args[3][0] == '#') {
+    return true;
+  }
+  if (argc == 4 && strcmp(args[3], "quit") == 0) {
+    return false;
+  }
+  if (argc == 4 && strcmp(args[3], "shutdown") == 0) {
+    srv->stopping = true;
+    /* Wakes up the workers waiting for connections. */
+    shutdown(srv->listener, SHUT_RDWR);
+    return false;
+  }
+
+  batch_job job;
+  memset(&job, 0, sizeof(job));
+  const sim_options *opts = &job.opts;
+  if (!parseOptions(argc, args, &job.opts)) {
+    fprintf(out, "error: Invalid options, the server printed why\n\n");
+    return true;
+  }
+  if (opts->num_traces != 1 || opts->verbose || opts->event_file_name ||
+      opts->icache.associativity || opts->sketch || opts->region_file_name ||
+      opts->num_cos || opts->checkpoint_file_name ||
+      opts->resume_file_name || opts->warm_file_name ||
+      opts->batch_file_name || opts->socket_name) {
+    fprintf(out, "error: A request simulates the served trace in one cache "
+                 "and the levels below it\n\n");
+    return true;
+  }
+  bool physical = opts->paging.policy != PAGING_NONE;
+  bool fits = fitsServer(srv, &opts->cache, physical, out);
+  for (int i = 0; fits && i < opts->num_levels; i++) {
+    fits = fitsServer(srv, &opts->levels[i].cache, physical, out);
+  }
+  if (!fits) {
+    return true;
+  }
+
+  if (opts->opt) {
+    simulateOptJob(&job, serverOptTrace(srv, opts->cache.num_block_bits));
   } else {
-    return 1;
+    simulateJob(&job, &srv->trace);
   }
+  if (job.pages_full) {
+    fprintf(out, "error: The trace touches more than %d GB of pages\n\n",
+            1 << (PAGING_PHYSICAL_BITS - 30));
+    return true;
+  }
+  printJob(out, &job);
+  fprintf(out, "\n");
+  return true;
 }
 
-bool nextAccess(FILE *trace_file, char *buffer, int buf_size,
-                mem_access *access) {
-  char *got;
-  for (;;) {
-    got = fgets(buffer, buf_size, trace_file);
-    if (!got) {
-      break;
+/*
+ * fitsServer - Check that a cache of a request is small enough to not
+ * exhaust the memory of the server, and within the limits that make the
+ * cache exit, answering with the error if it is not. Physical addresses
+ * are narrower than the ones of the trace.
+ */
+bool fitsServer(const server *srv, const cache_config *config,
+                bool physical, FILE *out) {
+  if (config->num_set_bits > 24 ||
+      config->associativity > SERVE_MAX_LINES >> config->num_set_bits ||
+      config->num_block_bits >= CACHE_ADDRESS_BITS) {
+    fprintf(out, "error: Caches of a request hold at most %d lines\n\n",
+            SERVE_MAX_LINES);
+    return false;
+  }
+  if (config->compact &&
+      config->associativity > CACHE_COMPACT_MAX_ASSOCIATIVITY) {
+    fprintf(out, "error: The compact cache supports at most %d lines per "
+                 "set\n\n",
+            CACHE_COMPACT_MAX_ASSOCIATIVITY);
+    return false;
+  }
+  if (config->compact && !physical &&
+      srv->max_address >> CACHE_ADDRESS_BITS) {
+    fprintf(out, "error: Addresses of the trace are too wide for the "
+                 "compact cache\n\n");
+    return false;
+  }
+  return true;
+}
+
+/*
+ * serverOptTrace - The served trace with the next uses for a block size.
+ * The first request that needs them computes them while the others wait.
+ */
+const opt_trace *serverOptTrace(server *srv, int num_block_bits) {
+  pthread_mutex_lock(&srv->opt_lock);
+  opt_trace *t = srv->opt_traces[num_block_bits];
+  if (!t) {
+    t = malloc(sizeof(opt_trace));
+    if (!t) {
+      printf("malloc failed");
+      exit(1);
     }
-    if (*got == ' ') {
-      switch (*(++got)) {
-      case 'L':
-        access->mode = LOAD;
-        break;
-      case 'S':
-        access->mode = STORE;
-        break;
-      case 'M':
-        access->mode = MODIFY;
-        break;
-      default:
-        printf("Unknown access mode: %c.\n", *got);
-        exit(1);
+    trace_reader reader;
+    if (!trace_open(&reader, srv->trace_name, srv->ring_depth, 0, false) ||
+        !opt_trace_load(t, &reader, num_block_bits)) {
+      printf("Unable to pack trace file: %s.\n", srv->trace_name);
+      exit(1);
+    }
+    trace_close(&reader);
+    srv->opt_traces[num_block_bits] = t;
+  }
+  pthread_mutex_unlock(&srv->opt_lock);
+  return t;
+}
+
+/*
+ * summarize - Print the summary of a simulation and keep its numbers, so
+ * the result cache does not read them back from .csim_results.
+ */
+void summarize(int hits, int misses, int evictions) {
+  printSummary(hits, misses, evictions);
+  summary.hits = hits;
+  summary.misses = misses;
+  summary.evictions = evictions;
+  summarized = true;
+}
+
+/*
+ * checkPaging - Exit if a simulation needed more frames than physical
+ * memory holds, its translations are wrong.
+ */
+void checkPaging(bool full) {
+  if (full) {
+    printf("The trace touches more than %d GB of pages\n",
+           1 << (PAGING_PHYSICAL_BITS - 30));
+    exit(1);
+  }
+}
+
+/*
+ * printJob - Print the statistics of a job the way simulate() does.
+ */
+void printJob(FILE *out, const batch_job *job) {
+  fprintf(out, "hits:%d misses:%d evictions:%d\n", job->stats.hits,
+          job->stats.misses, job->stats.evictions);
+  printBuffers(out, &job->opts, &job->stats);
+  if (job->opts.paging.policy != PAGING_NONE) {
+    printPaging(out, &job->opts, job->pages);
+  }
+  printTiming(out, &job->opts, job->levels, &job->stats);
+}
+
+/*
+ * sharedAccess - Access the shared cache for trace t, in the ways of its
+ * class if the cache is partitioned. Fills and writebacks of a private L1
+ * count as plain accesses of the shared cache, they are not logged. An
+ * eviction of another trace's line is charged to it.
+ */
+void sharedAccess(cache *shared, tenant *tenants, int t, partition *part,
+                  uint64_t address, bool write, cache_result *result,
+                  cache_update *update) {
+  if (part) {
+    *result = cache_access_ways(shared, address, write,
+                                part->classes[tenants[t].cos].ways, update);
+  } else {
+    *result = cache_access(shared, address, write, update);
+  }
+  if (*result == CACHE_EVICTION) {
+    int owner = (update->victim_block << shared->num_block_bits) >>
+                CACHE_ADDRESS_BITS;
+    if (owner != t) {
+      tenants[owner].evicted_by_others++;
+    }
+  }
+  if (tenants[t].l1.associativity) {
+    tenants[t].stats.hits += *result == CACHE_HIT;
+    tenants[t].stats.misses += *result != CACHE_HIT;
+    tenants[t].stats.evictions += *result == CACHE_EVICTION;
+    if (part) {
+      mem_access access = {.address = address, .mode = LOAD};
+      partition_access(part, tenants[t].cos, &access, 0, *result, update);
+    }
+  }
+}
+
+/*
+ * newPartition - The classes of service of --cos, or NULL without them.
+ * classes maps every region of the map (with several traces: every trace)
+ * to its class, to other if none was given for it. It has a slot more than
+ * there are regions or traces, for the addresses outside every region,
+ * which always go to other.
+ */
+partition *newPartition(const sim_options *opts, const cache *c,
+                        const region_map *regions, int *classes) {
+  if (!opts->num_cos) {
+    return NULL;
+  }
+  partition *part = malloc(sizeof(partition));
+  if (!part) {
+    printf("malloc failed");
+    exit(1);
+  }
+  partition_initialize(part, c);
+  int num_targets = regions ? regions->num_regions : opts->num_traces;
+  for (int i = 0; i < num_targets; i++) {
+    classes[i] = -1;
+  }
+  for (int i = 0; i < opts->num_cos; i++) {
+    const char *target = opts->cos_targets[i];
+    int found = -1;
+    for (int j = 0; j < num_targets && found < 0; j++) {
+      char number[16];
+      sprintf(number, "%d", j);
+      if (strcmp(target, regions ? regions->names[j] : number) == 0) {
+        found = j;
       }
-      assert(sscanf(++got, "%lx", &access->address) == 1);
+    }
+    if (found < 0 || classes[found] >= 0) {
+      printf("--cos %s: No such %s, or it has a class already\n", target,
+             regions ? "region" : "trace");
+      exit(1);
+    }
+    classes[found] = partition_add_class(part, target, opts->cos_ways[i]);
+  }
+  for (int i = 0; i <= num_targets; i++) {
+    if (i == num_targets || classes[i] < 0) {
+      classes[i] = part->num_classes;
+    }
+  }
+  return part;
+}
+
+/*
+ * reportOccupancy - Print the lines of every class for each multiple of
+ * --occupancy up to accesses. Runs only repeat hits, so the occupancy after
+ * a run is that after any of its accesses.
+ */
+void reportOccupancy(const sim_options *opts, const partition *part,
+                     uint64_t accesses, uint64_t *next) {
+  while (accesses >= *next) {
+    partition_print_occupancy(part, *next);
+    *next += opts->occupancy;
+  }
+}
+
+/*
+ * countAccess - Add the outcome of an access to the statistics. The second
+ * half of a MODIFY always hits.
+ */
+void countAccess(sim_stats *stats, const mem_access *access,
+                 cache_result result, const cache_update *update) {
+  stats->fill_bytes += update->fill_bytes;
+  stats->writeback_bytes += update->writeback_bytes;
+  stats->sub_block_misses += result == CACHE_SUB_BLOCK_MISS;
+  stats->hits += result == CACHE_HIT;
+  stats->misses += result != CACHE_HIT;
+  stats->evictions += result == CACHE_EVICTION;
+  stats->hits += access->mode == MODIFY;
+}
+
+/*
+ * printBuffers - Print the traffic of a sector cache, or what the victim or
+ * miss cache caught.
+ */
+void printBuffers(FILE *out, const sim_options *opts,
+                  const sim_stats *stats) {
+  if (opts->cache.sub_block_bits) {
+    fprintf(out,
+            "sector misses:%lu sub-block misses:%lu fill bytes:%lu "
+            "writeback bytes:%lu\n",
+            stats->misses - stats->sub_block_misses, stats->sub_block_misses,
+            stats->fill_bytes, stats->writeback_bytes);
+  }
+  if (opts->victim == VICTIM_CACHE) {
+    fprintf(out,
+            "victim hits:%lu swaps:%lu fill bytes:%lu writeback bytes:%lu\n",
+            stats->victim_hits, stats->victim_swaps, stats->fill_bytes,
+            stats->writeback_bytes);
+  } else if (opts->victim == MISS_CACHE) {
+    fprintf(out, "miss-cache hits:%lu fill bytes:%lu writeback bytes:%lu\n",
+            stats->victim_hits, stats->fill_bytes, stats->writeback_bytes);
+  }
+}
+
+/*
+ * printPaging - Print the paging policy and how many pages it mapped.
+ */
+void printPaging(FILE *out, const sim_options *opts, uint64_t pages) {
+  char name[32];
+  paging_describe(&opts->paging, name, sizeof(name));
+  fprintf(out, "paging:%s pages:%lu\n", name, pages);
+}
+
+/*
+ * chargeMemory - Pass the fill and writeback of an access on to the levels
+ * below and add up the cycles they take.
+ */
+void chargeMemory(hierarchy *h, int num_block_bits, uint64_t address,
+                  const cache_update *update, sim_stats *stats) {
+  if (update->fill_bytes) {
+    stats->miss_cycles += hierarchy_fill(h, address, update->fill_bytes,
+                                         &stats->writeback_cycles);
+  }
+  if (update->writeback_bytes) {
+    stats->writeback_cycles +=
+        hierarchy_writeback(h, update->writeback_block << num_block_bits,
+                            update->writeback_bytes);
+  }
+}
+
+/*
+ * printTiming - Print the statistics of the levels below and the estimated
+ * cycles. Every access costs the hit latency, misses add their penalty,
+ * divided by the misses that overlap, and writebacks add theirs.
+ */
+void printTiming(FILE *out, const sim_options *opts,
+                 const level_stats *levels, const sim_stats *stats) {
+  if (!opts->timing) {
+    return;
+  }
+  for (int i = 0; i < opts->num_levels; i++) {
+    fprintf(out, "L%d hits:%lu misses:%lu evictions:%lu\n", i + 2,
+            levels[i].hits, levels[i].misses, levels[i].evictions);
+  }
+  uint64_t accesses = (uint64_t)stats->hits + stats->misses;
+  const timing_model *t = &opts->timing_model;
+  double cycles = accesses * t->hit_latency +
+                  stats->miss_cycles / t->overlap + stats->writeback_cycles;
+  fprintf(out, "cycles:%.0f amat:%.2f\n", cycles,
+          accesses ? cycles / accesses : 0.0);
+}
+
+/* newSketches - Allocate the sketches if they were asked for. */
+sim_sketches *newSketches(const sim_options *opts) {
+  if (!opts->sketch) {
+    return NULL;
+  }
+  sim_sketches *sk = malloc(sizeof(sim_sketches));
+  if (!sk) {
+    printf("malloc failed");
+    exit(1);
+  }
+  hll_reset(&sk->window);
+  sk->window_start = 0;
+  count_min_initialize(&sk->missed_lines, opts->top);
+  count_min_initialize(&sk->evicted_sets, opts->top);
+  return sk;
+}
+
+/*
+ * sketchAccess - Add an access to the sketches. Only the first access of a
+ * run is seen, the others touch the same line and would not change them.
+ */
+void sketchAccess(sim_sketches *sk, cache_result result,
+                  const cache_update *update) {
+  hll_add(&sk->window, update->block);
+  if (result != CACHE_HIT) {
+    count_min_add(&sk->missed_lines, update->block);
+  }
+  if (result == CACHE_EVICTION) {
+    count_min_add(&sk->evicted_sets, update->set_idx);
+  }
+}
+
+/* closeWindow - Print the working set of the window ending at accesses. */
+void closeWindow(sim_sketches *sk, uint64_t accesses) {
+  if (accesses == sk->window_start) {
+    return;
+  }
+  printf("window:%lu-%lu lines:%lu\n", sk->window_start, accesses,
+         hll_estimate(&sk->window));
+  hll_reset(&sk->window);
+  sk->window_start = accesses;
+}
+
+void printSketches(const sim_sketches *sk, int num_block_bits) {
+  top_entry top[SKETCH_MAX_TOP];
+  int n = count_min_top(&sk->missed_lines, top);
+  printf("most missed lines:\n");
+  for (int i = 0; i < n; i++) {
+    printf("  %lx misses:%lu\n", top[i].key << num_block_bits, top[i].count);
+  }
+  n = count_min_top(&sk->evicted_sets, top);
+  printf("most evicting sets:\n");
+  for (int i = 0; i < n; i++) {
+    printf("  %lu evictions:%lu\n", top[i].key, top[i].count);
+  }
+}
+
+/*
+ * readNext - Read the next access into the filter's lookahead.
+ */
+bool readNext(access_filter *filter) {
+  return trace_next(filter->trace, &filter->next);
+}
+
+/*
+ * nextRun - Read the next run of accesses from the trace. Consecutive
+ * accesses to the same line are merged unless coalescing is off, which makes
+ * the filter read exactly one access per run. Instruction loads and data
+ * accesses never share a run, they go to different caches. Runs never
+ * extend past the barrier so that the caller sees the exact access counts
+ * it asked for.
+ */
+bool nextRun(access_filter *filter, access_run *run) {
+  if (!filter->has_next && !readNext(filter)) {
+    return false;
+  }
+  run->access = filter->next;
+  run->repeat_hits = 0;
+  run->repeat_writes = false;
+  filter->has_next = false;
+  filter->accesses++;
+  if (!filter->coalesce) {
+    return true;
+  }
+  /* Bit 63 is not part of the address, see cache_decode(). */
+  uint64_t unit = (run->access.address << 1) >> (filter->run_bits + 1);
+  while (filter->accesses != filter->barrier && readNext(filter)) {
+    if ((filter->next.address << 1) >> (filter->run_bits + 1) != unit ||
+        (filter->next.mode == INST) != (run->access.mode == INST)) {
+      filter->has_next = true;
       break;
     }
-    assert(*got == 'I');
+    run->repeat_hits += filter->next.mode == MODIFY ? 2 : 1;
+    run->repeat_writes |= filter->next.mode != LOAD;
+    filter->accesses++;
+  }
+  return true;
+}
+
+/*
+ * nextBarrier - The next access count after which the simulator has to stop
+ * and look at its state: the end of the warmup, the checkpoint or a window.
+ */
+uint64_t nextBarrier(const sim_options *opts, uint64_t accesses) {
+  uint64_t barrier = UINT64_MAX;
+  if (opts->warmup > accesses && opts->warmup < barrier) {
+    barrier = opts->warmup;
+  }
+  if (opts->checkpoint_at > accesses && opts->checkpoint_at < barrier) {
+    barrier = opts->checkpoint_at;
+  }
+  if (opts->sketch) {
+    uint64_t window_end = (accesses / opts->window + 1) * opts->window;
+    if (window_end < barrier) {
+      barrier = window_end;
+    }
   }
-  while (*buffer != '\0' && *buffer != '\n') {
-    buffer++;
+  return barrier;
+}
+
+/*
+ * writeSnapshot - Save the cache, the statistics and the trace position.
+ * The snapshot is written next to its final name and renamed into place,
+ * so a crash never leaves a truncated snapshot behind.
+ */
+void writeSnapshot(const char *file_name, cache *c, const victim_buffer *v,
+                   const sim_stats *stats, const access_filter *filter) {
+  char tmp_name[strlen(file_name) + 5];
+  snapshot_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.num_set_bits = c->num_set_bits;
+  header.num_block_bits = c->num_block_bits;
+  header.associativity = c->associativity;
+  header.index = c->index;
+  header.sub_block_bits = c->sub_block_bits;
+  header.victim = v->kind;
+  header.victim_entries = v->num_entries;
+  header.num_sets = c->num_sets;
+  header.stats = *stats;
+  header.accesses = filter->accesses;
+  trace_position(filter->trace, filter->has_next ? 1 : 0,
+                 &header.trace_offset, &header.trace_skip);
+
+  sprintf(tmp_name, "%s.tmp", file_name);
+  FILE *fp = fopen(tmp_name, "wb");
+  if (!fp) {
+    printf("Unable to open snapshot file: %s.\n", tmp_name);
+    exit(1);
   }
-  if (*buffer == '\n') {
-    *buffer = '\0';
+  fwrite(&header, sizeof(header), 1, fp);
+  cache_save(c, fp);
+  if (v->kind != VICTIM_NONE) {
+    victim_save(v, fp);
+  }
+  if (ferror(fp) || fclose(fp) != 0 || rename(tmp_name, file_name) != 0) {
+    printf("Unable to write snapshot file: %s.\n", file_name);
+    exit(1);
   }
-  return got != NULL;
 }
 
-void decode(uint64_t address, int num_set_bits, int num_block_bits,
-            uint64_t *set, uint64_t *tag) {
-  int64_t sign_bit = 1UL << 63;
-  address &= ~sign_bit;
-  address >>= num_block_bits;
-  *set = address & ~(sign_bit >> (63 - num_set_bits));
-  *tag = address >> num_set_bits;
+/*
+ * readSnapshot - Restore the cache and victim buffer from a snapshot. The
+ * statistics and the header are only returned when stats and header are
+ * given, a warm start reuses nothing but the cache contents.
+ */
+void readSnapshot(const char *file_name, cache *c, victim_buffer *v,
+                  sim_stats *stats, snapshot_header *header_out) {
+  snapshot_header header;
+  FILE *fp = fopen(file_name, "rb");
+  if (!fp) {
+    printf("Unable to open snapshot file: %s.\n", file_name);
+    exit(1);
+  }
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != SNAPSHOT_VERSION) {
+    printf("Not a snapshot file: %s.\n", file_name);
+    exit(1);
+  }
+  if (header.num_set_bits != c->num_set_bits ||
+      header.num_block_bits != c->num_block_bits ||
+      header.associativity != c->associativity ||
+      header.index != c->index || header.num_sets != c->num_sets ||
+      header.sub_block_bits != c->sub_block_bits) {
+    printf("Snapshot %s was taken with -S %lu -E %d -b %d and another "
+           "geometry or index function.\n",
+           file_name, header.num_sets, header.associativity,
+           header.num_block_bits);
+    exit(1);
+  }
+  if (header.victim != v->kind || header.victim_entries != v->num_entries) {
+    printf("Snapshot %s was taken with another victim or miss cache.\n",
+           file_name);
+    exit(1);
+  }
+  if (!cache_restore(c, fp) ||
+      (v->kind != VICTIM_NONE && !victim_restore(v, fp))) {
+    printf("Corrupt snapshot file: %s.\n", file_name);
+    exit(1);
+  }
+  fclose(fp);
+  if (stats) {
+    *stats = header.stats;
+  }
+  if (header_out) {
+    *header_out = header;
+  }
+}
+
+void checkpointHandler(int signum) { checkpoint_requested = 1; }
+
+bool parseCount(const char *arg, uint64_t *count) {
+  char *end;
+  *count = strtoull(arg, &end, 10);
+  return *arg != '\0' && *end == '\0';
+}
+
+bool parseIndex(const char *arg, index_function *index) {
+  static const char *names[] = {
+      [INDEX_BITS] = "bits",
+      [INDEX_XOR] = "xor",
+      [INDEX_PRIME] = "prime",
+      [INDEX_SKEWED] = "skewed",
+  };
+  for (int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (strcmp(arg, names[i]) == 0) {
+      *index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool parseEntries(const char *arg, int *entries) {
+  uint64_t count;
+  if (!parseCount(arg, &count) || count == 0 || count > VICTIM_MAX_ENTRIES) {
+    return false;
+  }
+  *entries = count;
+  return true;
+}
+
+/* parseLevel - Parse a level given as s:E:b:latency. */
+bool parseLevel(const char *arg, level_config *level) {
+  int end = 0;
+  memset(level, 0, sizeof(*level));
+  if (sscanf(arg, "%d:%d:%d:%u%n", &level->cache.num_set_bits,
+             &level->cache.associativity, &level->cache.num_block_bits,
+             &level->latency, &end) != 4 ||
+      arg[end] != '\0') {
+    return false;
+  }
+  return level->cache.num_set_bits >= 0 && level->cache.num_set_bits < 48 &&
+         level->cache.associativity > 0 && level->cache.num_block_bits > 0 &&
+         level->cache.num_block_bits < 48;
+}
+
+/* parseGeometry - Parse a cache given as s:E:b. */
+bool parseGeometry(const char *arg, cache_config *config) {
+  int end = 0;
+  memset(config, 0, sizeof(*config));
+  if (sscanf(arg, "%d:%d:%d%n", &config->num_set_bits,
+             &config->associativity, &config->num_block_bits, &end) != 3 ||
+      arg[end] != '\0') {
+    return false;
+  }
+  return config->num_set_bits >= 0 && config->num_set_bits < 48 &&
+         config->associativity > 0 && config->num_block_bits > 0 &&
+         config->num_block_bits < 48;
+}
+
+bool parseRate(const char *arg, double *rate) {
+  char *end;
+  *rate = strtod(arg, &end);
+  return *arg != '\0' && *end == '\0' && *rate > 0;
+}
+
+/*
+ * parsePaging - Parse a paging policy: sequential, random, color:<colors>
+ * or huge.
+ */
+bool parsePaging(const char *arg, paging_config *config) {
+  if (strcmp(arg, "sequential") == 0) {
+    config->policy = PAGING_SEQUENTIAL;
+  } else if (strcmp(arg, "random") == 0) {
+    config->policy = PAGING_RANDOM;
+  } else if (strcmp(arg, "huge") == 0) {
+    config->policy = PAGING_HUGE;
+  } else if (strncmp(arg, "color:", 6) == 0) {
+    uint64_t colors;
+    if (!parseCount(arg + 6, &colors) || colors == 0 ||
+        colors > PAGING_MAX_COLORS) {
+      return false;
+    }
+    config->policy = PAGING_COLOR;
+    config->colors = colors;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/*
+ * parseClass - Parse a class of service, <region or trace>:<way mask> with
+ * the mask in hex.
+ */
+bool parseClass(char *arg, char **target, uint64_t *ways) {
+  char *colon = strrchr(arg, ':');
+  char *end;
+  if (!colon || colon == arg) {
+    return false;
+  }
+  *ways = strtoul(colon + 1, &end, 16);
+  if (colon[1] == '\0' || *end != '\0' || *ways == 0) {
+    return false;
+  }
+  *colon = '\0';
+  *target = arg;
+  return true;
+}
+
+uint64_t largestPrime(uint64_t limit) {
+  for (uint64_t n = limit; n > 2; n--) {
+    bool prime = true;
+    for (uint64_t d = 2; d * d <= n && prime; d++) {
+      prime = n % d != 0;
+    }
+    if (prime) {
+      return n;
+    }
+  }
+  return 2;
+}
+
+/*
+ * openResultCache - Open the result cache of a simulation, keyed by its
+ * options with the files they name replaced by content hashes. Runs that
+ * write files, print every access or serve several simulations are not
+ * cached, nor are those with an input that cannot be read.
+ */
+bool openResultCache(const sim_options *opts, int argc, char *argv[],
+                     result_cache *rc) {
+  if (!opts->result_cache_dir || opts->batch_file_name || opts->socket_name ||
+      opts->verbose || opts->event_file_name || opts->checkpoint_file_name ||
+      !result_cache_open(rc, opts->result_cache_dir)) {
+    return false;
+  }
+  for (int i = 1; i < argc; i++) {
+    bool file = strcmp(argv[i], "-t") == 0 ||
+                strcmp(argv[i], "--regions") == 0 ||
+                strcmp(argv[i], "--resume") == 0 ||
+                strcmp(argv[i], "--warm") == 0;
+    /* These do not change the results. */
+    bool ignored = strcmp(argv[i], "--result-cache") == 0 ||
+                   strcmp(argv[i], "--threads") == 0 ||
+                   strcmp(argv[i], "--ring-depth") == 0;
+    if (file && i + 1 < argc) {
+      result_cache_add(rc, argv[i]);
+      if (!result_cache_add_file(rc, argv[++i])) {
+        result_cache_close(rc);
+        return false;
+      }
+    } else if (ignored) {
+      i++;
+    } else if (strcmp(argv[i], "--pipeline") != 0) {
+      result_cache_add(rc, argv[i]);
+    }
+  }
+  return true;
 }
 
 void printHelp(char *argv0) {
@@ -256,7 +2424,76 @@ void printHelp(char *argv0) {
   printf("  -s <num>   Number of set index bits.\n");
   printf("  -E <num>   Number of lines per set.\n");
   printf("  -b <num>   Number of block offset bits.\n");
-  printf("  -t <file>  Trace file.\n\n");
+  printf("  -t <file>  Trace file, plain or gzip/zstd compressed. Several "
+         "traces share the cache.\n");
+  printf("  -S <num>               Number of sets, for set counts that are "
+         "not a power of two.\n");
+  printf("  --index <function>     Set index: bits (default), xor, prime "
+         "or skewed.\n");
+  printf("  --sub-blocks <num>     Sector cache with <num> sub-blocks per "
+         "line.\n");
+  printf("  --victim-cache <num>   Keep the last <num> evicted lines in a "
+         "victim cache.\n");
+  printf("  --miss-cache <num>     Keep the last <num> missed lines in a "
+         "miss cache.\n");
+  printf("  --level <s:E:b:cycles> Add a cache level below, with its "
+         "lookup latency.\n");
+  printf("  --timing               Estimate cycles and AMAT.\n");
+  printf("  --pipeline             Simulate every --level on its own "
+         "thread.\n");
+  printf("  --hit-latency <num>    Cycles of a hit in the first level "
+         "(4).\n");
+  printf("  --mem-latency <num>    Cycles until memory responds (100).\n");
+  printf("  --mem-bandwidth <num>  Memory bytes per cycle (8).\n");
+  printf("  --writeback-cost <num> Cycles per line written back (0).\n");
+  printf("  --overlap <num>        Independent misses in flight (1).\n");
+  printf("  --sketch               Estimate the lines of every window and "
+         "the hottest lines and sets.\n");
+  printf("  --window <num>         Accesses per working set window "
+         "(100000).\n");
+  printf("  --top <num>            Lines and sets to list (10).\n");
+  printf("  --event-log <file>     Write a binary record of every access "
+         "to <file>.\n");
+  printf("  --icache <s:E:b>       Split L1, instruction loads go to this "
+         "cache.\n");
+  printf("  --regions <file>       Statistics per address range of <file>, "
+         "with lines \"name start end\".\n");
+  printf("  --paging <policy>      Translate to physical addresses: "
+         "sequential, random,\n"
+         "                         color:<num> or huge (2 MB) frames.\n");
+  printf("  --paging-seed <num>    Seed of the random frames (0).\n");
+  printf("  --cos <name>:<mask>    Class of service of a region or trace, "
+         "filling only the ways\n"
+         "                         in the hex mask.\n");
+  printf("  --occupancy <num>      Print the lines of every class every "
+         "<num> accesses.\n");
+  printf("  --private-l1 <s:E:b>   With several -t, give every trace its "
+         "own L1.\n");
+  printf("  --quantum <num>        With several -t, accesses of a trace "
+         "between switches (1).\n");
+  printf("  --batch <file>         Run the jobs in <file>, a line of "
+         "options per job.\n");
+  printf("  --serve <socket>       Answer requests, a line of options "
+         "each, on the trace of -t.\n");
+  printf("  --threads <num>        Threads for --batch, or connections "
+         "--serve answers at once\n"
+         "                         (one per CPU).\n");
+  printf("  --result-cache <dir>   Reuse the results of identical runs "
+         "stored in <dir>\n"
+         "                         ($CSIM_RESULT_CACHE).\n");
+  printf("  --opt                  Replace the line used furthest in the "
+         "future (Belady).\n");
+  printf("  --compact              Keep tags and LRU ages in flat arrays, "
+         "using less memory.\n");
+  printf("  --ring-depth <num>     Batches parsed ahead of the simulation, "
+         "0 parses inline.\n");
+  printf("  --checkpoint <file>    Snapshot file, written on SIGUSR1.\n");
+  printf("  --checkpoint-at <num>  Write the snapshot after <num> "
+         "accesses.\n");
+  printf("  --resume <file>        Continue from a snapshot.\n");
+  printf("  --warm <file>          Start with the cache of a snapshot.\n");
+  printf("  --warmup <num>         Exclude the first <num> accesses from "
+         "the statistics.\n\n");
   printf("Examples:\n");
   printf("linux> %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv0);
   printf("linux> %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n", argv0);
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+#
+# fuzz-csim.py - Differential fuzzer for the cache simulator. It runs
+#     ./csim and ./csim-ref with -v on random traces and random (s, E, b)
+#     configurations, in parallel on all cores, and compares their output
+#     line by line, ignoring trailing spaces. A trace that makes them
+#     disagree is shrunk to a small reproducer, which is written next to
+#     the command that shows the difference.
+#
+import multiprocessing
+import optparse
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+MODES = "LLLSSM"
+SIZES = [1, 2, 4, 8]
+
+#
+# randomConfig - pick a cache geometry small enough for conflicts to
+# happen on short traces
+#
+def randomConfig(rng):
+    return (rng.randint(1, 6), rng.randint(1, 8), rng.randint(1, 6))
+
+#
+# randomTrace - generate the lines of a trace. Accesses come from a few
+# streams with their own base and stride, so there are runs within a
+# line, reuse across lines and conflicts between the streams. Instruction
+# loads are mixed in as well, both simulators have to skip them.
+#
+def randomTrace(rng, max_accesses):
+    streams = []
+    for i in range(rng.randint(1, 4)):
+        base = rng.choice([0, rng.randrange(1 << 12), rng.randrange(1 << 32),
+                           rng.randrange(1 << 47)])
+        stride = rng.choice([0, 1, 4, 8, 16, 64, 256, 4096])
+        span = rng.choice([1 << 6, 1 << 10, 1 << 14])
+        streams.append([base, stride, span, 0])
+    lines = []
+    for i in range(rng.randint(1, max_accesses)):
+        if rng.random() < 0.05:
+            lines.append("I %x,%d" % (rng.randrange(1 << 24),
+                                      rng.choice(SIZES)))
+            continue
+        stream = rng.choice(streams)
+        base, stride, span, pos = stream
+        if rng.random() < 0.2:
+            address = base + rng.randrange(span)
+        else:
+            address = base + pos
+            stream[3] = (pos + stride) % span
+        lines.append(" %s %x,%d" % (rng.choice(MODES), address,
+                                    rng.choice(SIZES)))
+    return lines
+
+#
+# runSim - run a simulator on a trace in the scratch directory, so the
+# .csim_results it writes stays out of the way
+#
+def runSim(binary, args, config, trace_lines, scratch):
+    trace = os.path.join(scratch, "case.trace")
+    with open(trace, "w") as f:
+        f.write("\n".join(trace_lines) + "\n")
+    s, E, b = config
+    cmd = [binary, "-v", "-s", str(s), "-E", str(E), "-b", str(b),
+           "-t", trace] + args
+    p = subprocess.Popen(cmd, cwd=scratch, stdout=subprocess.PIPE,
+                         stderr=subprocess.STDOUT)
+    out = p.communicate()[0].replace(trace.encode(), b"TRACE")
+    # csim-ref ends its verbose lines with a space
+    return p.returncode, [line.rstrip() for line in out.splitlines()]
+
+#
+# differs - check whether csim and csim-ref disagree on a trace
+#
+def differs(opts, config, trace_lines, scratch):
+    return (runSim(opts.csim, opts.csim_args, config, trace_lines, scratch) !=
+            runSim(opts.ref, [], config, trace_lines, scratch))
+
+#
+# minimize - shrink a failing trace with delta debugging: drop ever
+# smaller chunks of lines for as long as the outputs still differ
+#
+def minimize(opts, config, trace_lines, scratch):
+    chunks = 2
+    while len(trace_lines) >= 2:
+        size = (len(trace_lines) + chunks - 1) // chunks
+        reduced = False
+        for start in range(0, len(trace_lines), size):
+            rest = trace_lines[:start] + trace_lines[start + size:]
+            if rest and differs(opts, config, rest, scratch):
+                trace_lines = rest
+                chunks = max(chunks - 1, 2)
+                reduced = True
+                break
+        if not reduced:
+            if size == 1:
+                break
+            chunks = min(chunks * 2, len(trace_lines))
+    return trace_lines
+
+#
+# runCase - run one case, derived from the seed alone so it can be
+# replayed with -n 1 --seed. Returns None or the minimized failure.
+#
+def runCase(args):
+    opts, seed = args
+    rng = random.Random(seed)
+    config = randomConfig(rng)
+    trace_lines = randomTrace(rng, opts.max_accesses)
+    scratch = tempfile.mkdtemp(prefix="fuzz-csim.")
+    try:
+        if not differs(opts, config, trace_lines, scratch):
+            return None
+        return (seed, config, minimize(opts, config, trace_lines, scratch))
+    finally:
+        shutil.rmtree(scratch)
+
+#
+# report - write the reproducer of a failure and print how to run it
+#
+def report(opts, failure):
+    seed, config, trace_lines = failure
+    name = os.path.join(opts.out_dir, "fuzz-%d.trace" % seed)
+    with open(name, "w") as f:
+        f.write("\n".join(trace_lines) + "\n")
+    s, E, b = config
+    print("MISMATCH seed %d (%d lines): diff <(%s -v -s %d -E %d -b %d -t %s"
+          " %s) <(%s -v -s %d -E %d -b %d -t %s)" %
+          (seed, len(trace_lines), opts.csim, s, E, b, name,
+           " ".join(opts.csim_args), opts.ref, s, E, b, name))
+    sys.stdout.flush()
+
+#
+# main - Main function
+#
+def main():
+    p = optparse.OptionParser(usage="%prog [options] [-- csim options]")
+    p.add_option("-n", type="int", dest="cases", default=1000,
+                 help="number of cases to run (1000)")
+    p.add_option("-j", type="int", dest="jobs",
+                 default=multiprocessing.cpu_count(),
+                 help="cases run in parallel (one per CPU)")
+    p.add_option("--seed", type="int", dest="seed", default=None,
+                 help="seed of the first case (from the clock)")
+    p.add_option("--max-accesses", type="int", dest="max_accesses",
+                 default=200, help="longest trace to generate (200)")
+    p.add_option("--csim", dest="csim", default="./csim",
+                 help="simulator under test (./csim)")
+    p.add_option("--ref", dest="ref", default="./csim-ref",
+                 help="reference simulator (./csim-ref)")
+    p.add_option("-o", dest="out_dir", default=".",
+                 help="directory for the reproducers (.)")
+    opts, args = p.parse_args()
+    # Extra arguments go to csim only, e.g. -- --compact --ring-depth 0
+    opts.csim_args = args
+    opts.csim = os.path.abspath(opts.csim)
+    opts.ref = os.path.abspath(opts.ref)
+    if opts.seed is None:
+        opts.seed = int(time.time())
+
+    print("Running %d cases from seed %d on %d jobs" %
+          (opts.cases, opts.seed, opts.jobs))
+    sys.stdout.flush()
+    start = time.time()
+    failures = 0
+    pool = multiprocessing.Pool(opts.jobs)
+    cases = [(opts, opts.seed + i) for i in range(opts.cases)]
+    for failure in pool.imap_unordered(runCase, cases, 8):
+        if failure:
+            failures += 1
+            report(opts, failure)
+    pool.close()
+    pool.join()
+    elapsed = time.time() - start
+    print("%d cases, %d mismatches, %.0f cases/minute" %
+          (opts.cases, failures, opts.cases * 60 / max(elapsed, 1e-3)))
+    sys.exit(1 if failures else 0)
+
+# execute main only if called as a script
+if __name__ == "__main__":
+    main()
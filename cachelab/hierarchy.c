@@ -0,0 +1,259 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hierarchy.h"
+#include "profile.h"
+
+void hierarchy_initialize(hierarchy *h, const level_config *levels,
+                          int num_levels, const timing_model *timing) {
+  h->num_levels = num_levels;
+  h->pipelined = false;
+  for (int i = 0; i < num_levels; i++) {
+    cache_initialize(&h->levels[i], &levels[i].cache);
+    h->latency[i] = levels[i].latency;
+  }
+  h->timing = *timing;
+  hierarchy_reset_stats(h);
+}
+
+void hierarchy_destroy(hierarchy *h) {
+  uint64_t miss_cycles, writeback_cycles;
+  hierarchy_finish(h, &miss_cycles, &writeback_cycles);
+  for (int i = 0; i < h->num_levels; i++) {
+    cache_destroy(&h->levels[i]);
+  }
+}
+
+static void forward(hierarchy *h, int i, uint64_t address, uint64_t bytes,
+                    level_request_kind kind);
+
+/*
+ * hierarchy_reset_stats - Clear the statistics. A pipelined hierarchy
+ * passes the reset down behind the requests in flight.
+ */
+void hierarchy_reset_stats(hierarchy *h) {
+  if (h->pipelined) {
+    forward(h, 0, 0, 0, LEVEL_RESET);
+    return;
+  }
+  memset(h->stats, 0, sizeof(h->stats));
+}
+
+static uint64_t transfer(const hierarchy *h, uint64_t bytes) {
+  return ceil(bytes / h->timing.memory_bandwidth);
+}
+
+/* level_access - Look address up in level i and count the result. */
+static void level_access(hierarchy *h, int i, uint64_t address, bool write,
+                         cache_update *update) {
+  cache_result result = cache_access(&h->levels[i], address, write, update);
+  if (result == CACHE_HIT) {
+    h->stats[i].hits++;
+  } else {
+    h->stats[i].misses++;
+    h->stats[i].evictions += result == CACHE_EVICTION;
+  }
+}
+
+/*
+ * access_level - Read or write address at level i and below. Returns the
+ * cycles until the data is there, the cost of the writebacks it caused is
+ * added to writeback_cycles.
+ */
+static uint64_t access_level(hierarchy *h, int i, uint64_t address,
+                             uint64_t bytes, bool write,
+                             uint64_t *writeback_cycles) {
+  if (i == h->num_levels) {
+    if (write) {
+      *writeback_cycles += transfer(h, bytes);
+      return 0;
+    }
+    return h->timing.memory_latency + transfer(h, bytes);
+  }
+  cache *c = &h->levels[i];
+  cache_update update;
+  level_access(h, i, address, write, &update);
+  uint64_t cycles = h->latency[i];
+  if (update.fill_bytes) {
+    cycles += access_level(h, i + 1, address, update.fill_bytes, false,
+                           writeback_cycles);
+  }
+  if (update.writeback_bytes) {
+    *writeback_cycles +=
+        h->timing.writeback_cost +
+        access_level(h, i + 1, update.writeback_block << c->num_block_bits,
+                     update.writeback_bytes, true, writeback_cycles);
+  }
+  return write ? 0 : cycles;
+}
+
+/*
+ * hierarchy_fill - Fetch bytes at address for the first level and return
+ * the cycles the fetch takes. The cost of the writebacks it caused is added
+ * to writeback_cycles.
+ */
+uint64_t hierarchy_fill(hierarchy *h, uint64_t address, uint64_t bytes,
+                        uint64_t *writeback_cycles) {
+  if (h->pipelined) {
+    forward(h, 0, address, bytes, LEVEL_FETCH);
+    return 0;
+  }
+  return access_level(h, 0, address, bytes, false, writeback_cycles);
+}
+
+/*
+ * hierarchy_writeback - Write back bytes at address from the first level
+ * and return the cycles it takes.
+ */
+uint64_t hierarchy_writeback(hierarchy *h, uint64_t address, uint64_t bytes) {
+  uint64_t writeback_cycles = h->timing.writeback_cost;
+  if (h->pipelined) {
+    forward(h, 0, address, bytes, LEVEL_WRITE);
+    return writeback_cycles;
+  }
+  access_level(h, 0, address, bytes, true, &writeback_cycles);
+  return writeback_cycles;
+}
+
+/*
+ * forward - Queue a request for level i, from the level above or the
+ * simulator for level 0. Requests of the last level go to memory, which
+ * is charged to that level right away. The batch is handed over once it
+ * is full, or with the end of the requests.
+ */
+static void forward(hierarchy *h, int i, uint64_t address, uint64_t bytes,
+                    level_request_kind kind) {
+  if (i == h->num_levels) {
+    if (kind == LEVEL_FETCH) {
+      h->miss_cycles[i - 1] += h->timing.memory_latency + transfer(h, bytes);
+    } else if (kind == LEVEL_WRITE) {
+      h->writeback_cycles[i - 1] += transfer(h, bytes);
+    }
+    return;
+  }
+  level_queue *q = &h->queues[i];
+  if (!q->pending) {
+    while (q->head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) ==
+           HIERARCHY_QUEUE_DEPTH) {
+      sched_yield();
+    }
+    q->pending = q->ring + q->head % HIERARCHY_QUEUE_DEPTH;
+    q->pending->count = 0;
+  }
+  level_request *r = &q->pending->requests[q->pending->count++];
+  r->address = address;
+  r->bytes = bytes;
+  r->kind = kind;
+  if (q->pending->count == HIERARCHY_BATCH || kind == LEVEL_END) {
+    q->pending = NULL;
+    __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+  }
+}
+
+/*
+ * run_level - Thread of a pipelined level: the part of access_level() for
+ * this level, with the accesses of the level below forwarded to its queue.
+ * The cycles are charged to this level, and a fetch stays one for the
+ * level below only if this level read.
+ */
+static void *run_level(void *arg) {
+  level_queue *q = arg;
+  hierarchy *h = q->h;
+  int i = q->level;
+  cache_update update;
+  for (size_t tail = q->tail;; tail++) {
+    while (__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == tail) {
+      sched_yield();
+    }
+    level_batch *batch = q->ring + tail % HIERARCHY_QUEUE_DEPTH;
+    for (size_t j = 0; j < batch->count; j++) {
+      level_request *r = &batch->requests[j];
+      switch (r->kind) {
+      case LEVEL_RESET:
+        memset(&h->stats[i], 0, sizeof(h->stats[i]));
+        h->miss_cycles[i] = h->writeback_cycles[i] = 0;
+        forward(h, i + 1, 0, 0, LEVEL_RESET);
+        continue;
+      case LEVEL_END:
+        forward(h, i + 1, 0, 0, LEVEL_END);
+        __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+        PROF_MERGE();
+        return NULL;
+      default:
+        break;
+      }
+      bool write = r->kind == LEVEL_WRITE;
+      level_access(h, i, r->address, write, &update);
+      if (r->kind == LEVEL_FETCH) {
+        h->miss_cycles[i] += h->latency[i];
+      }
+      if (update.fill_bytes) {
+        forward(h, i + 1, r->address, update.fill_bytes,
+                r->kind == LEVEL_FETCH ? LEVEL_FETCH : LEVEL_READ);
+      }
+      if (update.writeback_bytes) {
+        h->writeback_cycles[i] += h->timing.writeback_cost;
+        forward(h, i + 1,
+                update.writeback_block << h->levels[i].num_block_bits,
+                update.writeback_bytes, LEVEL_WRITE);
+      }
+    }
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+  }
+}
+
+/*
+ * hierarchy_start - Run every level on its own thread from now on.
+ */
+void hierarchy_start(hierarchy *h) {
+  if (h->pipelined || h->num_levels == 0) {
+    return;
+  }
+  for (int i = 0; i < h->num_levels; i++) {
+    level_queue *q = &h->queues[i];
+    memset(q, 0, sizeof(*q));
+    q->h = h;
+    q->level = i;
+    q->ring = malloc(HIERARCHY_QUEUE_DEPTH * sizeof(level_batch));
+    if (!q->ring) {
+      printf("malloc failed");
+      exit(1);
+    }
+    h->miss_cycles[i] = h->writeback_cycles[i] = 0;
+  }
+  h->pipelined = true;
+  for (int i = 0; i < h->num_levels; i++) {
+    if (pthread_create(&h->threads[i], NULL, run_level, &h->queues[i]) !=
+        0) {
+      printf("Unable to start level thread\n");
+      exit(1);
+    }
+  }
+}
+
+/*
+ * hierarchy_finish - Wait for a pipelined hierarchy to work off its
+ * requests and add the cycles its levels charged. The hierarchy runs on
+ * the calling thread again afterwards.
+ */
+void hierarchy_finish(hierarchy *h, uint64_t *miss_cycles,
+                      uint64_t *writeback_cycles) {
+  if (!h->pipelined) {
+    return;
+  }
+  forward(h, 0, 0, 0, LEVEL_END);
+  for (int i = 0; i < h->num_levels; i++) {
+    pthread_join(h->threads[i], NULL);
+  }
+  for (int i = 0; i < h->num_levels; i++) {
+    *miss_cycles += h->miss_cycles[i];
+    *writeback_cycles += h->writeback_cycles[i];
+    free(h->queues[i].ring);
+  }
+  h->pipelined = false;
+}
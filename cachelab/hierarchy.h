@@ -0,0 +1,113 @@
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cache.h"
+
+/* Levels below the first one, which the simulator owns itself. */
+#define HIERARCHY_MAX_LEVELS 3
+/* Requests per batch and batches per queue between pipelined levels. */
+#define HIERARCHY_BATCH 256
+#define HIERARCHY_QUEUE_DEPTH 16
+
+typedef struct level_config {
+  cache_config cache;
+  uint32_t latency; /* cycles to look up the level */
+} level_config;
+
+/*
+ * Cycle costs of the memory system. A miss costs the latencies of every
+ * level it looks up on the way down, plus the memory latency and the
+ * transfer time if it reaches memory. overlap is the number of independent
+ * misses in flight, miss penalties are divided by it.
+ */
+typedef struct timing_model {
+  uint32_t hit_latency;    /* first level */
+  uint32_t memory_latency;
+  double memory_bandwidth; /* bytes per cycle */
+  uint32_t writeback_cost; /* cycles per line written back */
+  double overlap;
+} timing_model;
+
+typedef struct level_stats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+} level_stats;
+
+typedef enum {
+  LEVEL_FETCH, /* fill of a read, its cycles are miss cycles */
+  LEVEL_READ,  /* fill of a writeback, its cycles are hidden */
+  LEVEL_WRITE,
+  LEVEL_RESET, /* end of the warmup */
+  LEVEL_END,
+} level_request_kind;
+
+typedef struct level_request {
+  uint64_t address;
+  uint64_t bytes;
+  level_request_kind kind;
+} level_request;
+
+typedef struct level_batch {
+  level_request requests[HIERARCHY_BATCH];
+  size_t count;
+} level_batch;
+
+struct hierarchy;
+
+/*
+ * The requests into a pipelined level. The level above owns head and the
+ * batches between tail and head, the level owns tail. Both sides yield
+ * instead of blocking when the ring is full or empty, as the trace ring
+ * does.
+ */
+typedef struct level_queue {
+  struct hierarchy *h;
+  int level;
+  level_batch *ring;
+  level_batch *pending; /* batch the level above is filling, if any */
+  size_t head __attribute__((aligned(64)));
+  size_t tail __attribute__((aligned(64)));
+} level_queue;
+
+/*
+ * The levels below the first cache. Fills and writebacks of a level are
+ * reads and writes of the level below, the last level reads from and
+ * writes to memory.
+ *
+ * A pipelined hierarchy runs every level on its own thread, fed by the
+ * level above through a queue. The cycles of an access are then only
+ * known once the levels are done, every level adds up what it charged
+ * and hierarchy_finish() hands the sums over. Every level sees the same
+ * requests in the same order as without the pipeline, so the statistics
+ * are the same too.
+ */
+typedef struct hierarchy {
+  int num_levels;
+  cache levels[HIERARCHY_MAX_LEVELS];
+  uint32_t latency[HIERARCHY_MAX_LEVELS];
+  level_stats stats[HIERARCHY_MAX_LEVELS];
+  timing_model timing;
+  bool pipelined;
+  level_queue queues[HIERARCHY_MAX_LEVELS];
+  pthread_t threads[HIERARCHY_MAX_LEVELS];
+  uint64_t miss_cycles[HIERARCHY_MAX_LEVELS]; /* charged while pipelined */
+  uint64_t writeback_cycles[HIERARCHY_MAX_LEVELS];
+} hierarchy;
+
+void hierarchy_initialize(hierarchy *h, const level_config *levels,
+                          int num_levels, const timing_model *timing);
+void hierarchy_destroy(hierarchy *h);
+void hierarchy_reset_stats(hierarchy *h);
+void hierarchy_start(hierarchy *h);
+void hierarchy_finish(hierarchy *h, uint64_t *miss_cycles,
+                      uint64_t *writeback_cycles);
+uint64_t hierarchy_fill(hierarchy *h, uint64_t address, uint64_t bytes,
+                        uint64_t *writeback_cycles);
+uint64_t hierarchy_writeback(hierarchy *h, uint64_t address, uint64_t bytes);
+
+#endif
@@ -0,0 +1,265 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "opt.h"
+
+static void *allocate(size_t size) {
+  void *p = calloc(1, size);
+  if (!p) {
+    printf("malloc failed");
+    exit(1);
+  }
+  return p;
+}
+
+static uint64_t hash(uint64_t block) {
+  return (block * 0x9e3779b97f4a7c15UL) >> 17;
+}
+
+/* Block address of an access, bit 63 is not part of the address. */
+static uint64_t block_of(uint64_t address, int num_block_bits) {
+  return (address << 1) >> (num_block_bits + 1);
+}
+
+/*
+ * Open addressing table from block to the last (in the reverse pass: the
+ * next) access, grown as the footprint of the trace grows.
+ */
+typedef struct use_table {
+  uint64_t *keys; /* block + 1, 0 for an empty bucket */
+  uint64_t *uses;
+  uint64_t mask;
+  uint64_t size;
+} use_table;
+
+static uint64_t *use_find(use_table *u, uint64_t block) {
+  uint64_t i = hash(block) & u->mask;
+  while (u->keys[i] && u->keys[i] != block + 1) {
+    i = (i + 1) & u->mask;
+  }
+  if (!u->keys[i]) {
+    u->keys[i] = block + 1;
+    u->uses[i] = OPT_NEVER;
+    u->size++;
+  }
+  return u->uses + i;
+}
+
+static void use_grow(use_table *u) {
+  use_table grown = {
+      .keys = allocate(2 * (u->mask + 1) * sizeof(uint64_t)),
+      .uses = allocate(2 * (u->mask + 1) * sizeof(uint64_t)),
+      .mask = 2 * u->mask + 1,
+  };
+  for (uint64_t i = 0; i <= u->mask; i++) {
+    if (u->keys[i]) {
+      *use_find(&grown, u->keys[i] - 1) = u->uses[i];
+    }
+  }
+  free(u->keys);
+  free(u->uses);
+  *u = grown;
+}
+
+/*
+ * opt_trace_load - Pack the trace, then fill in the next uses in a pass
+ * from the end of the trace to its start.
+ */
+bool opt_trace_load(opt_trace *t, trace_reader *r, int num_block_bits) {
+  if (!trace_pack(r, &t->packed)) {
+    return false;
+  }
+  uint64_t count = t->packed.count;
+  const mem_access *accesses = t->packed.accesses;
+  FILE *uses = tmpfile();
+  t->next_use = NULL;
+  if (uses && ftruncate(fileno(uses), count * sizeof(uint64_t)) == 0 &&
+      count > 0) {
+    t->next_use = mmap(NULL, count * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fileno(uses), 0);
+  }
+  /* The mapping keeps the file alive. */
+  if (uses) {
+    fclose(uses);
+  }
+  if (count > 0 && (!t->next_use || t->next_use == MAP_FAILED)) {
+    trace_unpack(&t->packed);
+    return false;
+  }
+
+  use_table u = {
+      .keys = allocate(1024 * sizeof(uint64_t)),
+      .uses = allocate(1024 * sizeof(uint64_t)),
+      .mask = 1023,
+  };
+  for (uint64_t i = count; i-- > 0;) {
+    uint64_t *next =
+        use_find(&u, block_of(accesses[i].address, num_block_bits));
+    t->next_use[i] = *next;
+    *next = i;
+    if (2 * u.size > u.mask) {
+      use_grow(&u);
+    }
+  }
+  free(u.keys);
+  free(u.uses);
+  return true;
+}
+
+void opt_trace_unload(opt_trace *t) {
+  if (t->packed.count > 0) {
+    munmap(t->next_use, t->packed.count * sizeof(uint64_t));
+  }
+  trace_unpack(&t->packed);
+}
+
+void opt_initialize(opt_cache *o, const cache *geometry) {
+  uint64_t num_lines = geometry->num_sets * geometry->associativity;
+  uint64_t buckets = 2;
+  while (buckets < 2 * num_lines) {
+    buckets <<= 1;
+  }
+  o->geometry = geometry;
+  o->blocks = allocate(num_lines * sizeof(uint64_t));
+  o->keys = allocate(num_lines * sizeof(uint64_t));
+  o->dirty = allocate(num_lines);
+  o->heap = allocate(num_lines * sizeof(uint32_t));
+  o->heap_pos = allocate(num_lines * sizeof(uint32_t));
+  o->fill = allocate(geometry->num_sets * sizeof(uint32_t));
+  o->table_keys = allocate(buckets * sizeof(uint64_t));
+  o->table_slots = allocate(buckets * sizeof(uint64_t));
+  o->table_mask = buckets - 1;
+}
+
+void opt_destroy(opt_cache *o) {
+  free(o->blocks);
+  free(o->keys);
+  free(o->dirty);
+  free(o->heap);
+  free(o->heap_pos);
+  free(o->fill);
+  free(o->table_keys);
+  free(o->table_slots);
+}
+
+static uint64_t table_bucket(const opt_cache *o, uint64_t block) {
+  uint64_t i = hash(block) & o->table_mask;
+  while (o->table_keys[i] && o->table_keys[i] != block + 1) {
+    i = (i + 1) & o->table_mask;
+  }
+  return i;
+}
+
+/*
+ * table_remove - Empty bucket i and shift later entries of its cluster
+ * back, so that no lookup runs into the hole.
+ */
+static void table_remove(opt_cache *o, uint64_t i) {
+  for (uint64_t j = (i + 1) & o->table_mask; o->table_keys[j];
+       j = (j + 1) & o->table_mask) {
+    uint64_t home = hash(o->table_keys[j] - 1) & o->table_mask;
+    if (((j - home) & o->table_mask) >= ((j - i) & o->table_mask)) {
+      o->table_keys[i] = o->table_keys[j];
+      o->table_slots[i] = o->table_slots[j];
+      i = j;
+    }
+  }
+  o->table_keys[i] = 0;
+}
+
+static void heap_swap(opt_cache *o, uint64_t base, uint32_t a, uint32_t b) {
+  uint32_t way = o->heap[base + a];
+  o->heap[base + a] = o->heap[base + b];
+  o->heap[base + b] = way;
+  o->heap_pos[base + o->heap[base + a]] = a;
+  o->heap_pos[base + o->heap[base + b]] = b;
+}
+
+/* heap_fix - Restore the heap after the key at position pos changed. */
+static void heap_fix(opt_cache *o, uint64_t set_idx, uint32_t pos) {
+  uint64_t base = set_idx * o->geometry->associativity;
+  uint32_t size = o->fill[set_idx];
+  while (pos > 0 && o->keys[base + o->heap[base + pos]] >
+                        o->keys[base + o->heap[base + (pos - 1) / 2]]) {
+    heap_swap(o, base, pos, (pos - 1) / 2);
+    pos = (pos - 1) / 2;
+  }
+  for (;;) {
+    uint32_t largest = pos;
+    for (uint32_t child = 2 * pos + 1; child <= 2 * pos + 2; child++) {
+      if (child < size && o->keys[base + o->heap[base + child]] >
+                              o->keys[base + o->heap[base + largest]]) {
+        largest = child;
+      }
+    }
+    if (largest == pos) {
+      break;
+    }
+    heap_swap(o, base, pos, largest);
+    pos = largest;
+  }
+}
+
+/*
+ * opt_access - Simulate an access to address whose block is used again at
+ * next_use. A miss in a full set evicts the line whose next use is the
+ * furthest away.
+ */
+cache_result opt_access(opt_cache *o, uint64_t address, uint64_t next_use,
+                        bool write, cache_update *update) {
+  const cache *c = o->geometry;
+  memset(update, 0, sizeof(*update));
+  cache_decode(c, address, &update->set_idx, &update->tag);
+  update->block = block_of(address, c->num_block_bits);
+
+  uint64_t base = update->set_idx * c->associativity;
+  uint64_t bucket = table_bucket(o, update->block);
+  if (o->table_keys[bucket]) {
+    uint64_t slot = o->table_slots[bucket];
+    o->keys[slot] = next_use;
+    o->dirty[slot] |= write;
+    heap_fix(o, update->set_idx, o->heap_pos[slot]);
+    update->slot = slot;
+    return CACHE_HIT;
+  }
+
+  cache_result result = CACHE_MISS;
+  uint64_t slot;
+  uint32_t pos;
+  if (o->fill[update->set_idx] < c->associativity) {
+    pos = o->fill[update->set_idx]++;
+    slot = base + pos;
+    o->heap[slot] = pos;
+    o->heap_pos[slot] = pos;
+  } else {
+    result = CACHE_EVICTION;
+    pos = 0;
+    slot = base + o->heap[base];
+    update->victim_block = o->blocks[slot];
+    uint64_t victim_set;
+    cache_decode(c, o->blocks[slot] << c->num_block_bits, &victim_set,
+                 &update->victim_tag);
+    update->victim_dirty = o->dirty[slot];
+    update->writeback_block = update->victim_block;
+    table_remove(o, table_bucket(o, o->blocks[slot]));
+    bucket = table_bucket(o, update->block);
+  }
+  o->blocks[slot] = update->block;
+  o->keys[slot] = next_use;
+  o->dirty[slot] = write;
+  o->table_keys[bucket] = update->block + 1;
+  o->table_slots[bucket] = slot;
+  heap_fix(o, update->set_idx, pos);
+  update->slot = slot;
+  update->fill_bytes = 1UL << c->num_block_bits;
+  if (update->victim_dirty) {
+    update->writeback_bytes = 1UL << c->num_block_bits;
+  }
+  return result;
+}
@@ -0,0 +1,49 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "trace.h"
+
+/* Next use of a block that is never accessed again. */
+#define OPT_NEVER UINT64_MAX
+
+/*
+ * A packed trace with the index of the next access to the same block for
+ * every access. Both arrays are mapped from temporary files, so the kernel
+ * can page them out, but they grow with the length of the trace.
+ */
+typedef struct opt_trace {
+  packed_trace packed;
+  uint64_t *next_use;
+} opt_trace;
+
+/*
+ * Cache that replaces the line used furthest in the future (Belady's MIN).
+ * keys holds the next use of the line in every slot and heap keeps the
+ * ways of every set in a max-heap on that key, heap_pos is the position
+ * of a slot in its heap. The table maps resident blocks to their slot.
+ */
+typedef struct opt_cache {
+  const cache *geometry; /* decodes addresses, its lines are not used */
+  uint64_t *blocks;
+  uint64_t *keys;
+  uint8_t *dirty;
+  uint32_t *heap;
+  uint32_t *heap_pos;
+  uint32_t *fill;
+  uint64_t *table_keys; /* block + 1, 0 for an empty bucket */
+  uint64_t *table_slots;
+  uint64_t table_mask;
+} opt_cache;
+
+bool opt_trace_load(opt_trace *t, trace_reader *r, int num_block_bits);
+void opt_trace_unload(opt_trace *t);
+void opt_initialize(opt_cache *o, const cache *geometry);
+void opt_destroy(opt_cache *o);
+cache_result opt_access(opt_cache *o, uint64_t address, uint64_t next_use,
+                        bool write, cache_update *update);
+
+#endif
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "paging.h"
+
+static void *allocate(size_t size) {
+  void *p = calloc(1, size);
+  if (!p) {
+    printf("malloc failed");
+    exit(1);
+  }
+  return p;
+}
+
+static uint64_t hash(uint64_t page) {
+  return (page * 0x9e3779b97f4a7c15UL) >> 17;
+}
+
+/*
+ * permute - A bijection of the numbers below 2^bits chosen by the seed.
+ * Adding, multiplying by an odd number and xoring in the upper half are
+ * each invertible modulo 2^bits, so distinct frame counts always give
+ * distinct frames, without tracking which frames are free.
+ */
+static uint64_t permute(uint64_t x, uint64_t seed, int bits) {
+  uint64_t mask = (1UL << bits) - 1;
+  for (int round = 0; round < 4; round++) {
+    seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+    x = (x + (seed >> 17)) & mask;
+    x = (x * ((seed >> 31) | 1)) & mask;
+    x ^= x >> (bits / 2);
+  }
+  return x;
+}
+
+void paging_initialize(page_table *p, const paging_config *config) {
+  memset(p, 0, sizeof(*p));
+  p->config = *config;
+  p->page_bits =
+      config->policy == PAGING_HUGE ? HUGE_PAGE_BITS : PAGE_BITS;
+  p->mask = 1023;
+  p->pages = allocate((p->mask + 1) * sizeof(uint64_t));
+  p->frames = allocate((p->mask + 1) * sizeof(uint64_t));
+  p->next_frames = allocate(
+      (config->policy == PAGING_COLOR ? config->colors : 1) *
+      sizeof(uint64_t));
+  p->last_page = UINT64_MAX;
+}
+
+void paging_destroy(page_table *p) {
+  free(p->pages);
+  free(p->frames);
+  free(p->next_frames);
+}
+
+static void grow(page_table *p) {
+  uint64_t mask = 2 * p->mask + 1;
+  uint64_t *pages = allocate((mask + 1) * sizeof(uint64_t));
+  uint64_t *frames = allocate((mask + 1) * sizeof(uint64_t));
+  for (uint64_t i = 0; i <= p->mask; i++) {
+    if (p->pages[i]) {
+      uint64_t j = hash(p->pages[i] - 1) & mask;
+      while (pages[j]) {
+        j = (j + 1) & mask;
+      }
+      pages[j] = p->pages[i];
+      frames[j] = p->frames[i];
+    }
+  }
+  free(p->pages);
+  free(p->frames);
+  p->pages = pages;
+  p->frames = frames;
+  p->mask = mask;
+}
+
+/*
+ * allocate_frame - The frame for a page touched for the first time. Color
+ * i holds the frames i, i + colors, i + 2 colors and so on, and a page gets
+ * the color of its virtual page number.
+ */
+static uint64_t allocate_frame(page_table *p, uint64_t page) {
+  int frame_bits = PAGING_PHYSICAL_BITS - p->page_bits;
+  uint64_t frame;
+  switch (p->config.policy) {
+  case PAGING_COLOR: {
+    uint64_t color = page % p->config.colors;
+    frame = color + p->next_frames[color]++ * p->config.colors;
+    break;
+  }
+  case PAGING_RANDOM:
+  case PAGING_HUGE:
+    frame = permute(p->next_frames[0]++, p->config.seed, frame_bits);
+    break;
+  default:
+    frame = p->next_frames[0]++;
+    break;
+  }
+  /* More pages than frames. Reported by the caller, which can then
+     refuse the request rather than exit. */
+  p->full |= frame >> frame_bits != 0 || p->next_frames[0] > 1UL << frame_bits;
+  return frame & ((1UL << frame_bits) - 1);
+}
+
+/*
+ * paging_translate - The physical address of a virtual address, mapping
+ * its page if this is the first access to it.
+ */
+uint64_t paging_translate(page_table *p, uint64_t address) {
+  /* Bit 63 is not part of the address, see cache_decode(). */
+  address &= ~(1UL << 63);
+  uint64_t page = address >> p->page_bits;
+  uint64_t offset = address & ((1UL << p->page_bits) - 1);
+  if (page == p->last_page) {
+    return p->last_frame << p->page_bits | offset;
+  }
+  uint64_t i = hash(page) & p->mask;
+  while (p->pages[i] && p->pages[i] != page + 1) {
+    i = (i + 1) & p->mask;
+  }
+  if (!p->pages[i]) {
+    p->pages[i] = page + 1;
+    p->frames[i] = allocate_frame(p, page);
+    if (++p->size > p->mask / 2) {
+      uint64_t frame = p->frames[i];
+      grow(p);
+      p->last_page = page;
+      p->last_frame = frame;
+      return frame << p->page_bits | offset;
+    }
+  }
+  p->last_page = page;
+  p->last_frame = p->frames[i];
+  return p->last_frame << p->page_bits | offset;
+}
+
+/*
+ * paging_describe - Name a policy the way --paging takes it.
+ */
+void paging_describe(const paging_config *config, char *buffer,
+                     size_t size) {
+  static const char *names[] = {"virtual", "sequential", "random", "color",
+                                "huge"};
+  if (config->policy == PAGING_COLOR) {
+    snprintf(buffer, size, "color:%d", config->colors);
+  } else {
+    snprintf(buffer, size, "%s", names[config->policy]);
+  }
+}
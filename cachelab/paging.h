@@ -0,0 +1,50 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PAGE_BITS 12      /* 4 KB pages */
+#define HUGE_PAGE_BITS 21 /* 2 MB pages */
+#define PAGING_MAX_COLORS 4096
+#define PAGING_PHYSICAL_BITS 36 /* random frames are drawn from 64 GB */
+
+typedef enum {
+  PAGING_NONE,       /* caches see virtual addresses */
+  PAGING_SEQUENTIAL, /* frames handed out in the order pages are touched */
+  PAGING_RANDOM,     /* a random free frame for every page */
+  PAGING_COLOR,      /* the next frame of the color of the virtual page */
+  PAGING_HUGE,       /* a random free 2 MB frame for every 2 MB page */
+} paging_policy;
+
+typedef struct paging_config {
+  paging_policy policy;
+  int colors; /* with PAGING_COLOR */
+  uint64_t seed;
+} paging_config;
+
+/*
+ * Maps the pages of a trace to physical frames on first touch, like an OS
+ * would. The last translation is kept, as runs of accesses stay in a page.
+ */
+typedef struct page_table {
+  paging_config config;
+  int page_bits;
+  uint64_t *pages; /* page + 1, 0 for an empty bucket */
+  uint64_t *frames;
+  uint64_t mask;
+  uint64_t size;         /* pages mapped */
+  uint64_t *next_frames; /* per color, the next frame to hand out */
+  uint64_t last_page;
+  uint64_t last_frame;
+  bool full; /* a page found no frame, the translations are wrong */
+} page_table;
+
+void paging_initialize(page_table *p, const paging_config *config);
+void paging_destroy(page_table *p);
+uint64_t paging_translate(page_table *p, uint64_t address);
+void paging_describe(const paging_config *config, char *buffer,
+                     size_t size);
+
+#endif
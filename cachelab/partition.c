@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "partition.h"
+
+void partition_initialize(partition *p, const cache *c) {
+  memset(p, 0, sizeof(*p));
+  p->owners = calloc(c->num_sets * c->associativity, sizeof(uint8_t));
+  if (!p->owners) {
+    printf("malloc failed");
+    exit(1);
+  }
+  strcpy(p->classes[0].name, "other");
+  p->classes[0].ways = c->associativity < 64 ? (1UL << c->associativity) - 1
+                                             : ~0UL;
+}
+
+void partition_destroy(partition *p) {
+  free(p->owners);
+}
+
+/*
+ * partition_add_class - Add a class of service that may fill ways and
+ * return its index.
+ */
+int partition_add_class(partition *p, const char *name, uint64_t ways) {
+  int cls = p->num_classes++;
+  p->classes[cls + 1] = p->classes[cls];
+  memset(&p->classes[cls], 0, sizeof(partition_class));
+  snprintf(p->classes[cls].name, PARTITION_NAME_LENGTH, "%s", name);
+  p->classes[cls].ways = ways;
+  return cls;
+}
+
+/*
+ * partition_access - Count an access of class cls, and the repeat_hits to
+ * the same line after it. A miss hands the line it went to over to cls.
+ */
+void partition_access(partition *p, int cls, const mem_access *access,
+                      int repeat_hits, cache_result result,
+                      const cache_update *update) {
+  partition_class *c = &p->classes[cls];
+  c->hits += (result == CACHE_HIT) + (access->mode == MODIFY) + repeat_hits;
+  c->misses += result != CACHE_HIT;
+  c->evictions += result == CACHE_EVICTION;
+  if (result == CACHE_MISS || result == CACHE_EVICTION) {
+    uint8_t *owner = &p->owners[update->slot];
+    if (*owner) {
+      p->classes[*owner - 1].lines--;
+    }
+    *owner = cls + 1;
+    c->lines++;
+  }
+}
+
+/*
+ * partition_reset_stats - Clear the counts, the lines stay with the classes
+ * that filled them.
+ */
+void partition_reset_stats(partition *p) {
+  for (int i = 0; i <= p->num_classes; i++) {
+    p->classes[i].hits = 0;
+    p->classes[i].misses = 0;
+    p->classes[i].evictions = 0;
+  }
+}
+
+void partition_print_occupancy(const partition *p, uint64_t accesses) {
+  printf("occupancy at %lu:", accesses);
+  for (int i = 0; i <= p->num_classes; i++) {
+    printf(" %s:%lu", p->classes[i].name, p->classes[i].lines);
+  }
+  printf("\n");
+}
+
+/*
+ * partition_print - Print every class with its ways and counts, and other
+ * if any access belonged to no class.
+ */
+void partition_print(const partition *p) {
+  for (int i = 0; i <= p->num_classes; i++) {
+    const partition_class *c = &p->classes[i];
+    if (i == p->num_classes && c->hits + c->misses == 0) {
+      break;
+    }
+    printf("class %s ways:%lx hits:%lu misses:%lu evictions:%lu "
+           "lines:%lu\n",
+           c->name, c->ways, c->hits, c->misses, c->evictions, c->lines);
+  }
+}
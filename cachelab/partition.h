@@ -0,0 +1,43 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <stdint.h>
+
+#include "cache.h"
+#include "trace.h"
+
+#define PARTITION_MAX_CLASSES 8
+#define PARTITION_NAME_LENGTH 32
+
+/* A class of service: the ways it may fill, and what it did with them. */
+typedef struct partition_class {
+  char name[PARTITION_NAME_LENGTH];
+  uint64_t ways;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  uint64_t lines; /* lines it filled that are still in the cache */
+} partition_class;
+
+/*
+ * The classes of service of a way partitioned cache. Accesses that belong
+ * to no class use all ways as the extra class "other" at num_classes.
+ * owners holds, per line of the cache, the class that filled it plus one.
+ */
+typedef struct partition {
+  int num_classes;
+  partition_class classes[PARTITION_MAX_CLASSES + 1];
+  uint8_t *owners;
+} partition;
+
+void partition_initialize(partition *p, const cache *c);
+void partition_destroy(partition *p);
+int partition_add_class(partition *p, const char *name, uint64_t ways);
+void partition_access(partition *p, int cls, const mem_access *access,
+                      int repeat_hits, cache_result result,
+                      const cache_update *update);
+void partition_reset_stats(partition *p);
+void partition_print_occupancy(const partition *p, uint64_t accesses);
+void partition_print(const partition *p);
+
+#endif
@@ -0,0 +1,119 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+#include "profile.h"
+
+/*
+ * The jobs a worker has left, front to back. The owner takes jobs from
+ * the back, thieves take them from the front.
+ */
+typedef struct work_queue {
+  pthread_mutex_t lock;
+  size_t *jobs;
+  size_t front;
+  size_t back;
+} work_queue;
+
+typedef struct pool {
+  work_queue *queues;
+  int num_threads;
+  pool_job run;
+  void *context;
+} pool;
+
+typedef struct worker {
+  pool *pool;
+  int id;
+} worker;
+
+static bool take(work_queue *q, bool steal, size_t *job) {
+  bool got = false;
+  pthread_mutex_lock(&q->lock);
+  if (q->front < q->back) {
+    *job = steal ? q->jobs[q->front++] : q->jobs[--q->back];
+    got = true;
+  }
+  pthread_mutex_unlock(&q->lock);
+  return got;
+}
+
+/*
+ * work - Run the jobs of the own queue, then steal from the others. Jobs
+ * never add jobs, so once every queue is empty the worker is done.
+ */
+static void *work(void *arg) {
+  worker *w = arg;
+  pool *p = w->pool;
+  size_t job;
+  for (;;) {
+    if (take(&p->queues[w->id], false, &job)) {
+      p->run(job, p->context);
+      continue;
+    }
+    bool stolen = false;
+    for (int i = 1; i < p->num_threads && !stolen; i++) {
+      stolen = take(&p->queues[(w->id + i) % p->num_threads], true, &job);
+    }
+    if (!stolen) {
+      PROF_MERGE();
+      return NULL;
+    }
+    p->run(job, p->context);
+  }
+}
+
+/*
+ * pool_run - Run jobs 0 to num_jobs - 1 on num_threads threads. Every
+ * thread starts with a contiguous share of the jobs and steals from the
+ * others when it runs out.
+ */
+void pool_run(size_t num_jobs, int num_threads, pool_job run, void *context) {
+  if (num_threads > num_jobs) {
+    num_threads = num_jobs ? num_jobs : 1;
+  }
+  pool p = {
+      .queues = calloc(num_threads, sizeof(work_queue)),
+      .num_threads = num_threads,
+      .run = run,
+      .context = context,
+  };
+  worker *workers = calloc(num_threads, sizeof(worker));
+  pthread_t *threads = calloc(num_threads, sizeof(pthread_t));
+  size_t *jobs = malloc((num_jobs ? num_jobs : 1) * sizeof(size_t));
+  if (!p.queues || !workers || !threads || !jobs) {
+    printf("malloc failed");
+    exit(1);
+  }
+  for (size_t i = 0; i < num_jobs; i++) {
+    jobs[i] = i;
+  }
+  for (int i = 0; i < num_threads; i++) {
+    work_queue *q = &p.queues[i];
+    pthread_mutex_init(&q->lock, NULL);
+    q->jobs = jobs;
+    q->front = num_jobs * i / num_threads;
+    q->back = num_jobs * (i + 1) / num_threads;
+    workers[i].pool = &p;
+    workers[i].id = i;
+  }
+  for (int i = 1; i < num_threads; i++) {
+    if (pthread_create(&threads[i], NULL, work, &workers[i]) != 0) {
+      printf("Unable to start worker thread\n");
+      exit(1);
+    }
+  }
+  work(&workers[0]);
+  for (int i = 1; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  for (int i = 0; i < num_threads; i++) {
+    pthread_mutex_destroy(&p.queues[i].lock);
+  }
+  free(jobs);
+  free(threads);
+  free(workers);
+  free(p.queues);
+}
@@ -0,0 +1,10 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+typedef void (*pool_job)(size_t job, void *context);
+
+void pool_run(size_t num_jobs, int num_threads, pool_job run, void *context);
+
+#endif
@@ -0,0 +1,901 @@
+/*
+ * predict-trans.c - Predicts the misses of transpose functions without
+ *     tracing them. A candidate is a spec file describing the matrices and
+ *     the loop nest that walks them, with affine subscripts. The nest is
+ *     run symbolically and every reference is classified by its reuse
+ *     distance within its cache set: it hits if fewer than E other lines
+ *     of the set were touched since its line was last used, which is
+ *     exactly when an LRU cache hits. Misses are split into cold ones and
+ *     those on lines evicted earlier, by the matrix that evicted them.
+ *
+ *     Several spec files, and several values of their parameters, are
+ *     ranked by predicted misses. With -c the trace of every candidate is
+ *     run through ./csim to check the prediction.
+ *
+ * A spec file has a statement per line, # starts a comment:
+ *
+ *     param <name> <value>               constant, overridden by -D
+ *     array <name> <base> <row> [<size>] matrix at address <base>, with
+ *                                        <row> elements of <size> bytes
+ *                                        (4) per row
+ *     for <var> <from> <to> [<step>]     loop while <var> < <to>
+ *     if <expr> <op> <expr>              op is ==, !=, <, <=, > or >=
+ *     else
+ *     end                                closes a for, if or else
+ *     read <array> <row> <col>
+ *     write <array> <row> <col>
+ *
+ * Expressions are made of integers, names, + - * / %, parentheses,
+ * min(a,b) and max(a,b), without spaces.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_NAMES 64
+#define MAX_ARRAYS 8
+#define MAX_REFS 256
+#define MAX_DEPTH 32
+#define MAX_DEFINES 16
+#define MAX_VALUES 64
+#define MAX_CANDIDATES 4096
+#define MAX_LINE 1024
+#define NAME_LEN 32
+
+/* Trace of a candidate, run through ./csim by -c */
+#define CHECK_TRACE "trace.predict"
+
+typedef enum expr_kind {
+  EXPR_CONST,
+  EXPR_NAME,
+  EXPR_ADD,
+  EXPR_SUB,
+  EXPR_MUL,
+  EXPR_DIV,
+  EXPR_MOD,
+  EXPR_MIN,
+  EXPR_MAX
+} expr_kind;
+
+typedef struct expr {
+  expr_kind kind;
+  int64_t value; /* of a constant, or the slot of a name */
+  struct expr *left;
+  struct expr *right;
+} expr;
+
+typedef enum cmp_op { CMP_EQ, CMP_NE, CMP_LT, CMP_LE, CMP_GT, CMP_GE } cmp_op;
+
+typedef enum node_kind { NODE_FOR, NODE_IF, NODE_REF } node_kind;
+
+/* A statement of the loop nest. */
+typedef struct node {
+  node_kind kind;
+  int var;  /* slot of the loop variable */
+  int ref;  /* index into spec.refs */
+  cmp_op op;
+  expr *a;  /* from, left side or row */
+  expr *b;  /* to, right side or column */
+  expr *c;  /* step */
+  struct node *body;
+  struct node *other; /* else branch */
+  struct node *next;
+} node;
+
+typedef struct array {
+  char name[NAME_LEN];
+  uint64_t base;
+  expr *row_length;
+  int64_t row; /* row_length, evaluated for the candidate */
+  int size;
+} array;
+
+typedef struct ref_stats {
+  int line; /* in the spec file */
+  int array;
+  bool write;
+  char text[96]; /* as written in the spec */
+  uint64_t accesses;
+  uint64_t hits;
+  uint64_t cold;
+  uint64_t evicted_by[MAX_ARRAYS]; /* misses on lines that array evicted */
+} ref_stats;
+
+typedef struct spec {
+  const char *file_name;
+  char names[MAX_NAMES][NAME_LEN];
+  bool is_param[MAX_NAMES];
+  int64_t values[MAX_NAMES];
+  int num_names;
+  array arrays[MAX_ARRAYS];
+  int num_arrays;
+  ref_stats refs[MAX_REFS];
+  int num_refs;
+  node *root;
+} spec;
+
+typedef struct candidate {
+  spec s;
+  char label[256];
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  bool checked;
+  bool matches; /* ./csim agrees */
+} candidate;
+
+/* Values of a parameter to try, from -D name=v1,v2,... */
+typedef struct define {
+  char name[NAME_LEN];
+  int64_t values[MAX_VALUES];
+  int num_values;
+} define;
+
+/*
+ * The cache: the lines of every set, most recently used first, so the
+ * position of a line is its reuse distance within the set. Every line
+ * touched is remembered along with the array that last evicted it.
+ */
+typedef struct model {
+  int s;
+  int E;
+  int b;
+  uint64_t *lines;
+  int *fill;
+  uint64_t *seen; /* line + 1, 0 for an empty slot */
+  int8_t *evictor;
+  size_t seen_size;
+  size_t seen_count;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  FILE *trace;
+} model;
+
+static const char *file_name;
+static int line_number;
+
+void parseSpec(const char *name, spec *sp);
+expr *parseExpr(spec *sp, const char **p);
+int64_t eval(const expr *e, const int64_t *values);
+bool compare(int64_t left, cmp_op op, int64_t right);
+void expandDefines(const spec *sp, const define *defines, int num_defines,
+                   int d, char *label, candidate **cands, int *num_cands);
+void runCandidate(candidate *cand, model *m);
+void runNodes(spec *sp, const node *n, model *m);
+void modelAccess(model *m, const spec *sp, ref_stats *r, uint64_t address);
+bool checkCandidate(candidate *cand, model *m);
+void printBreakdown(const candidate *cand);
+void usage(char *argv[]);
+
+static void *allocate(size_t size) {
+  void *p = calloc(1, size);
+  if (!p) {
+    printf("malloc failed");
+    exit(1);
+  }
+  return p;
+}
+
+static void parseError(const char *message, const char *what) {
+  printf("%s:%d: %s%s\n", file_name, line_number, message, what);
+  exit(1);
+}
+
+static int findName(const spec *sp, const char *name) {
+  for (int i = 0; i < sp->num_names; i++) {
+    if (strcmp(sp->names[i], name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int addName(spec *sp, const char *name, bool param) {
+  int slot = findName(sp, name);
+  if (slot >= 0) {
+    if (sp->is_param[slot] || param) {
+      parseError("name defined twice: ", name);
+    }
+    return slot;
+  }
+  if (sp->num_names == MAX_NAMES || strlen(name) >= NAME_LEN) {
+    parseError("too many or too long names: ", name);
+  }
+  slot = sp->num_names++;
+  strcpy(sp->names[slot], name);
+  sp->is_param[slot] = param;
+  return slot;
+}
+
+static int findArray(const spec *sp, const char *name) {
+  for (int i = 0; i < sp->num_arrays; i++) {
+    if (strcmp(sp->arrays[i].name, name) == 0) {
+      return i;
+    }
+  }
+  parseError("unknown array: ", name);
+  return -1;
+}
+
+static expr *newExpr(expr_kind kind, expr *left, expr *right) {
+  expr *e = allocate(sizeof(expr));
+  e->kind = kind;
+  e->left = left;
+  e->right = right;
+  return e;
+}
+
+/* parseWhole - Parse a token that must be a single expression. */
+static expr *parseWhole(spec *sp, const char *token) {
+  const char *p = token;
+  expr *e = parseExpr(sp, &p);
+  if (*p != '\0') {
+    parseError("bad expression: ", token);
+  }
+  return e;
+}
+
+/*
+ * parseFactor - A number, a name, a parenthesized expression, min(a,b),
+ * max(a,b) or a negated factor.
+ */
+static expr *parseFactor(spec *sp, const char **p) {
+  char name[NAME_LEN];
+  int len = 0;
+  if (**p == '-') {
+    (*p)++;
+    return newExpr(EXPR_SUB, newExpr(EXPR_CONST, NULL, NULL),
+                   parseFactor(sp, p));
+  }
+  if (**p == '(') {
+    (*p)++;
+    expr *e = parseExpr(sp, p);
+    if (**p != ')') {
+      parseError("missing ) in expression", "");
+    }
+    (*p)++;
+    return e;
+  }
+  if (isdigit((unsigned char)**p)) {
+    char *end;
+    expr *e = newExpr(EXPR_CONST, NULL, NULL);
+    e->value = strtoll(*p, &end, 0);
+    *p = end;
+    return e;
+  }
+  while (isalnum((unsigned char)**p) || **p == '_') {
+    if (len == NAME_LEN - 1) {
+      parseError("name too long in expression", "");
+    }
+    name[len++] = *(*p)++;
+  }
+  name[len] = '\0';
+  if (len == 0) {
+    parseError("bad expression at: ", *p);
+  }
+  if ((strcmp(name, "min") == 0 || strcmp(name, "max") == 0) &&
+      **p == '(') {
+    (*p)++;
+    expr *left = parseExpr(sp, p);
+    if (**p != ',') {
+      parseError("missing , in ", name);
+    }
+    (*p)++;
+    expr *right = parseExpr(sp, p);
+    if (**p != ')') {
+      parseError("missing ) in ", name);
+    }
+    (*p)++;
+    return newExpr(name[1] == 'i' ? EXPR_MIN : EXPR_MAX, left, right);
+  }
+  int slot = findName(sp, name);
+  if (slot < 0) {
+    parseError("unknown name: ", name);
+  }
+  expr *e = newExpr(EXPR_NAME, NULL, NULL);
+  e->value = slot;
+  return e;
+}
+
+static expr *parseTerm(spec *sp, const char **p) {
+  expr *e = parseFactor(sp, p);
+  while (**p == '*' || **p == '/' || **p == '%') {
+    char op = *(*p)++;
+    expr_kind kind = op == '*' ? EXPR_MUL : op == '/' ? EXPR_DIV : EXPR_MOD;
+    e = newExpr(kind, e, parseFactor(sp, p));
+  }
+  return e;
+}
+
+/*
+ * parseExpr - Parse an expression at *p, leaving *p after it.
+ */
+expr *parseExpr(spec *sp, const char **p) {
+  expr *e = parseTerm(sp, p);
+  while (**p == '+' || **p == '-') {
+    char op = *(*p)++;
+    e = newExpr(op == '+' ? EXPR_ADD : EXPR_SUB, e, parseTerm(sp, p));
+  }
+  return e;
+}
+
+static cmp_op parseOp(const char *token) {
+  static const char *ops[] = {"==", "!=", "<", "<=", ">", ">="};
+  for (int i = 0; i < 6; i++) {
+    if (strcmp(token, ops[i]) == 0) {
+      return (cmp_op)i;
+    }
+  }
+  parseError("unknown comparison: ", token);
+  return CMP_EQ;
+}
+
+/*
+ * parseSpec - Read a spec file, exiting with the line that is wrong if it
+ * does not parse.
+ */
+void parseSpec(const char *name, spec *sp) {
+  FILE *fp = fopen(name, "r");
+  if (!fp) {
+    printf("Unable to open spec file: %s.\n", name);
+    exit(1);
+  }
+  memset(sp, 0, sizeof(*sp));
+  sp->file_name = name;
+  file_name = name;
+  line_number = 0;
+
+  node *open[MAX_DEPTH];
+  node **tail[MAX_DEPTH];
+  bool in_else[MAX_DEPTH];
+  int depth = 0;
+  tail[0] = &sp->root;
+
+  char line[MAX_LINE];
+  while (fgets(line, sizeof(line), fp)) {
+    line_number++;
+    char *comment = strchr(line, '#');
+    if (comment) {
+      *comment = '\0';
+    }
+    char *tokens[8];
+    int n = 0;
+    char *save;
+    for (char *t = strtok_r(line, " \t\r\n", &save); t;
+         t = strtok_r(NULL, " \t\r\n", &save)) {
+      if (n == 8) {
+        parseError("too many fields", "");
+      }
+      tokens[n++] = t;
+    }
+    if (n == 0) {
+      continue;
+    }
+
+    node *nd = NULL;
+    if (strcmp(tokens[0], "param") == 0 && n == 3) {
+      int slot = addName(sp, tokens[1], true);
+      sp->values[slot] = strtoll(tokens[2], NULL, 0);
+    } else if (strcmp(tokens[0], "array") == 0 && (n == 4 || n == 5)) {
+      if (sp->num_arrays == MAX_ARRAYS ||
+          strlen(tokens[1]) >= NAME_LEN) {
+        parseError("too many arrays or too long a name: ", tokens[1]);
+      }
+      array *a = &sp->arrays[sp->num_arrays++];
+      strcpy(a->name, tokens[1]);
+      a->base = strtoull(tokens[2], NULL, 0);
+      a->row_length = parseWhole(sp, tokens[3]);
+      a->size = n == 5 ? atoi(tokens[4]) : 4;
+      if (a->size <= 0) {
+        parseError("bad element size: ", tokens[4]);
+      }
+    } else if (strcmp(tokens[0], "for") == 0 && (n == 4 || n == 5)) {
+      nd = allocate(sizeof(node));
+      nd->kind = NODE_FOR;
+      /* The bounds are parsed before the variable comes into scope. */
+      nd->a = parseWhole(sp, tokens[2]);
+      nd->b = parseWhole(sp, tokens[3]);
+      nd->c = n == 5 ? parseWhole(sp, tokens[4]) : NULL;
+      nd->var = addName(sp, tokens[1], false);
+    } else if (strcmp(tokens[0], "if") == 0 && n == 4) {
+      nd = allocate(sizeof(node));
+      nd->kind = NODE_IF;
+      nd->a = parseWhole(sp, tokens[1]);
+      nd->op = parseOp(tokens[2]);
+      nd->b = parseWhole(sp, tokens[3]);
+    } else if ((strcmp(tokens[0], "read") == 0 ||
+                strcmp(tokens[0], "write") == 0) &&
+               n == 4) {
+      if (sp->num_refs == MAX_REFS) {
+        parseError("too many references", "");
+      }
+      nd = allocate(sizeof(node));
+      nd->kind = NODE_REF;
+      nd->ref = sp->num_refs++;
+      nd->a = parseWhole(sp, tokens[2]);
+      nd->b = parseWhole(sp, tokens[3]);
+      ref_stats *r = &sp->refs[nd->ref];
+      r->line = line_number;
+      r->array = findArray(sp, tokens[1]);
+      r->write = tokens[0][0] == 'w';
+      snprintf(r->text, sizeof(r->text), "%s %s[%s][%s]", tokens[0],
+               tokens[1], tokens[2], tokens[3]);
+    } else if (strcmp(tokens[0], "else") == 0 && n == 1) {
+      if (depth == 0 || open[depth]->kind != NODE_IF || in_else[depth]) {
+        parseError("else without if", "");
+      }
+      tail[depth] = &open[depth]->other;
+      in_else[depth] = true;
+    } else if (strcmp(tokens[0], "end") == 0 && n == 1) {
+      if (depth == 0) {
+        parseError("end without for or if", "");
+      }
+      depth--;
+    } else {
+      parseError("bad statement: ", tokens[0]);
+    }
+
+    if (nd) {
+      *tail[depth] = nd;
+      tail[depth] = &nd->next;
+      if (nd->kind != NODE_REF) {
+        if (depth + 1 == MAX_DEPTH) {
+          parseError("nested too deep", "");
+        }
+        depth++;
+        open[depth] = nd;
+        tail[depth] = &nd->body;
+        in_else[depth] = false;
+      }
+    }
+  }
+  fclose(fp);
+  if (depth != 0) {
+    parseError("missing end", "");
+  }
+}
+
+/*
+ * eval - Evaluate an expression with the current values of the names.
+ */
+int64_t eval(const expr *e, const int64_t *values) {
+  int64_t left, right;
+  switch (e->kind) {
+  case EXPR_CONST:
+    return e->value;
+  case EXPR_NAME:
+    return values[e->value];
+  default:
+    break;
+  }
+  left = eval(e->left, values);
+  right = eval(e->right, values);
+  switch (e->kind) {
+  case EXPR_ADD:
+    return left + right;
+  case EXPR_SUB:
+    return left - right;
+  case EXPR_MUL:
+    return left * right;
+  case EXPR_MIN:
+    return left < right ? left : right;
+  case EXPR_MAX:
+    return left > right ? left : right;
+  default:
+    if (right == 0) {
+      printf("Division by zero in %s.\n", file_name);
+      exit(1);
+    }
+    return e->kind == EXPR_DIV ? left / right : left % right;
+  }
+}
+
+bool compare(int64_t left, cmp_op op, int64_t right) {
+  switch (op) {
+  case CMP_EQ:
+    return left == right;
+  case CMP_NE:
+    return left != right;
+  case CMP_LT:
+    return left < right;
+  case CMP_LE:
+    return left <= right;
+  case CMP_GT:
+    return left > right;
+  default:
+    return left >= right;
+  }
+}
+
+/*
+ * seenLine - The evictor slot of a line, adding it if it was never touched
+ * (cold is then set).
+ */
+static int8_t *seenLine(model *m, uint64_t line, bool *cold) {
+  if (2 * (m->seen_count + 1) > m->seen_size) {
+    uint64_t *old = m->seen;
+    int8_t *old_evictor = m->evictor;
+    size_t old_size = m->seen_size;
+    m->seen_size = old_size ? 2 * old_size : 1024;
+    m->seen = allocate(m->seen_size * sizeof(uint64_t));
+    m->evictor = allocate(m->seen_size);
+    m->seen_count = 0;
+    for (size_t i = 0; i < old_size; i++) {
+      if (old[i]) {
+        bool unused;
+        *seenLine(m, old[i] - 1, &unused) = old_evictor[i];
+      }
+    }
+    free(old);
+    free(old_evictor);
+  }
+  size_t mask = m->seen_size - 1;
+  size_t i = (line * 0x9e3779b97f4a7c15UL) >> 20 & mask;
+  while (m->seen[i] && m->seen[i] != line + 1) {
+    i = (i + 1) & mask;
+  }
+  *cold = !m->seen[i];
+  if (*cold) {
+    m->seen[i] = line + 1;
+    m->evictor[i] = -1;
+    m->seen_count++;
+  }
+  return &m->evictor[i];
+}
+
+/*
+ * modelAccess - Classify an access by the reuse distance of its line in
+ * its set, then make the line the most recently used one.
+ */
+void modelAccess(model *m, const spec *sp, ref_stats *r, uint64_t address) {
+  uint64_t line = address >> m->b;
+  uint64_t set = line & ((1UL << m->s) - 1);
+  uint64_t *ways = m->lines + set * m->E;
+  int fill = m->fill[set];
+  int distance = 0;
+  while (distance < fill && ways[distance] != line) {
+    distance++;
+  }
+
+  r->accesses++;
+  if (distance < fill) {
+    r->hits++;
+    m->hits++;
+  } else {
+    bool cold;
+    int8_t evictor = *seenLine(m, line, &cold);
+    m->misses++;
+    if (cold) {
+      r->cold++;
+    } else {
+      r->evicted_by[evictor]++;
+    }
+    if (fill == m->E) {
+      bool unused;
+      *seenLine(m, ways[fill - 1], &unused) = r->array;
+      m->evictions++;
+      distance = fill - 1;
+    } else {
+      m->fill[set]++;
+    }
+  }
+  memmove(ways + 1, ways, distance * sizeof(*ways));
+  ways[0] = line;
+
+  if (m->trace) {
+    fprintf(m->trace, " %c %lx,%d\n", r->write ? 'S' : 'L', address,
+            sp->arrays[r->array].size);
+  }
+}
+
+/*
+ * runNodes - Run a list of statements with the current values of the
+ * loop variables.
+ */
+void runNodes(spec *sp, const node *n, model *m) {
+  for (; n; n = n->next) {
+    if (n->kind == NODE_FOR) {
+      int64_t to = eval(n->b, sp->values);
+      int64_t step = n->c ? eval(n->c, sp->values) : 1;
+      if (step <= 0) {
+        printf("%s: loop over %s with a step of %ld.\n", sp->file_name,
+               sp->names[n->var], step);
+        exit(1);
+      }
+      for (int64_t v = eval(n->a, sp->values); v < to; v += step) {
+        sp->values[n->var] = v;
+        runNodes(sp, n->body, m);
+      }
+    } else if (n->kind == NODE_IF) {
+      if (compare(eval(n->a, sp->values), n->op, eval(n->b, sp->values))) {
+        runNodes(sp, n->body, m);
+      } else {
+        runNodes(sp, n->other, m);
+      }
+    } else {
+      ref_stats *r = &sp->refs[n->ref];
+      const array *a = &sp->arrays[r->array];
+      int64_t element =
+          eval(n->a, sp->values) * a->row + eval(n->b, sp->values);
+      modelAccess(m, sp, r, a->base + element * a->size);
+    }
+  }
+}
+
+/*
+ * runCandidate - Predict the misses of a candidate on an empty cache.
+ */
+void runCandidate(candidate *cand, model *m) {
+  spec *sp = &cand->s;
+  memset(m->fill, 0, (sizeof(int)) << m->s);
+  if (m->seen) {
+    memset(m->seen, 0, m->seen_size * sizeof(uint64_t));
+  }
+  m->seen_count = 0;
+  m->hits = m->misses = m->evictions = 0;
+  for (int i = 0; i < sp->num_refs; i++) {
+    ref_stats *r = &sp->refs[i];
+    r->accesses = r->hits = r->cold = 0;
+    memset(r->evicted_by, 0, sizeof(r->evicted_by));
+  }
+  for (int i = 0; i < sp->num_arrays; i++) {
+    sp->arrays[i].row = eval(sp->arrays[i].row_length, sp->values);
+  }
+  runNodes(sp, sp->root, m);
+  cand->hits = m->hits;
+  cand->misses = m->misses;
+  cand->evictions = m->evictions;
+}
+
+/*
+ * checkCandidate - Run the trace of a candidate through ./csim and compare
+ * its counts with the prediction.
+ */
+bool checkCandidate(candidate *cand, model *m) {
+  uint64_t hits = cand->hits, misses = cand->misses;
+  uint64_t evictions = cand->evictions;
+  m->trace = fopen(CHECK_TRACE, "w");
+  if (!m->trace) {
+    printf("Unable to write %s.\n", CHECK_TRACE);
+    exit(1);
+  }
+  runCandidate(cand, m);
+  fclose(m->trace);
+  m->trace = NULL;
+
+  char cmd[256];
+  unsigned csim_hits, csim_misses, csim_evictions;
+  sprintf(cmd, "./csim -s %d -E %d -b %d -t %s > /dev/null", m->s, m->E, m->b,
+          CHECK_TRACE);
+  FILE *in_fp;
+  if (system(cmd) != 0 || !(in_fp = fopen(".csim_results", "r"))) {
+    printf("Unable to run ./csim.\n");
+    exit(1);
+  }
+  int fields =
+      fscanf(in_fp, "%u %u %u", &csim_hits, &csim_misses, &csim_evictions);
+  fclose(in_fp);
+  remove(CHECK_TRACE);
+  return fields == 3 && csim_hits == hits && csim_misses == misses &&
+         csim_evictions == evictions;
+}
+
+/*
+ * expandDefines - Make a candidate of the spec for every combination of the
+ * -D values of the parameters it declares.
+ */
+void expandDefines(const spec *sp, const define *defines, int num_defines,
+                   int d, char *label, candidate **cands, int *num_cands) {
+  if (d == num_defines) {
+    if (*num_cands == MAX_CANDIDATES) {
+      printf("More than %d candidates.\n", MAX_CANDIDATES);
+      exit(1);
+    }
+    candidate *cand = allocate(sizeof(candidate));
+    cand->s = *sp;
+    snprintf(cand->label, sizeof(cand->label), "%s%s", sp->file_name, label);
+    cands[(*num_cands)++] = cand;
+    return;
+  }
+  int slot = findName(sp, defines[d].name);
+  if (slot < 0 || !sp->is_param[slot]) {
+    expandDefines(sp, defines, num_defines, d + 1, label, cands, num_cands);
+    return;
+  }
+  size_t len = strlen(label);
+  spec *copy = allocate(sizeof(spec));
+  *copy = *sp;
+  for (int i = 0; i < defines[d].num_values; i++) {
+    copy->values[slot] = defines[d].values[i];
+    snprintf(label + len, 256 - len, " %s=%ld", defines[d].name,
+             defines[d].values[i]);
+    expandDefines(copy, defines, num_defines, d + 1, label, cands,
+                  num_cands);
+  }
+  label[len] = '\0';
+  free(copy);
+}
+
+static int byMisses(const void *a, const void *b) {
+  const candidate *x = *(candidate *const *)a;
+  const candidate *y = *(candidate *const *)b;
+  return (x->misses > y->misses) - (x->misses < y->misses);
+}
+
+/*
+ * printBreakdown - Print the misses of every reference of a candidate, and
+ * which array evicted the lines it missed on.
+ */
+void printBreakdown(const candidate *cand) {
+  const spec *sp = &cand->s;
+  printf("\n%s:\n  line  %-24s %8s %8s %8s", cand->label, "reference",
+         "accesses", "misses", "cold");
+  for (int i = 0; i < sp->num_arrays; i++) {
+    printf(" %5s %2s", "by", sp->arrays[i].name);
+  }
+  printf("\n");
+  for (int i = 0; i < sp->num_refs; i++) {
+    const ref_stats *r = &sp->refs[i];
+    printf("  %4d  %-24s %8lu %8lu %8lu", r->line, r->text, r->accesses,
+           r->accesses - r->hits, r->cold);
+    for (int j = 0; j < sp->num_arrays; j++) {
+      printf(" %8lu", r->evicted_by[j]);
+    }
+    printf("\n");
+  }
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[]) {
+  printf("Usage: %s [-hvc] [-s <s>] [-E <E>] [-b <b>] "
+         "[-D <name>=<values>] <spec>...\n",
+         argv[0]);
+  printf("Options:\n");
+  printf("  -h          Print this help message.\n");
+  printf("  -v          Print the misses of every reference.\n");
+  printf("  -c          Check every prediction with ./csim.\n");
+  printf("  -s <num>    Number of set index bits (5).\n");
+  printf("  -E <num>    Number of lines per set (1).\n");
+  printf("  -b <num>    Number of block offset bits (5).\n");
+  printf("  -D <n>=<v>  Set parameter <n>, a comma separated list of values\n"
+         "              makes a candidate of each.\n");
+  printf("  -t          Print the trace of the only candidate instead.\n");
+  printf("Example: %s -D T=4,8,16 specs/*.spec\n", argv[0]);
+}
+
+int main(int argc, char *argv[]) {
+  model m;
+  define defines[MAX_DEFINES];
+  int num_defines = 0;
+  bool verbose = false, check = false, trace = false;
+  char c;
+
+  memset(&m, 0, sizeof(m));
+  m.s = 5;
+  m.E = 1;
+  m.b = 5;
+  while ((c = getopt(argc, argv, "hvcts:E:b:D:")) != -1) {
+    switch (c) {
+    case 'v':
+      verbose = true;
+      break;
+    case 'c':
+      check = true;
+      break;
+    case 't':
+      trace = true;
+      break;
+    case 's':
+      m.s = atoi(optarg);
+      break;
+    case 'E':
+      m.E = atoi(optarg);
+      break;
+    case 'b':
+      m.b = atoi(optarg);
+      break;
+    case 'D': {
+      char *eq = strchr(optarg, '=');
+      if (num_defines == MAX_DEFINES || !eq || eq - optarg >= NAME_LEN) {
+        printf("%s: bad parameter: %s\n", argv[0], optarg);
+        exit(1);
+      }
+      define *d = &defines[num_defines++];
+      memcpy(d->name, optarg, eq - optarg);
+      d->name[eq - optarg] = '\0';
+      d->num_values = 0;
+      char *save;
+      for (char *v = strtok_r(eq + 1, ",", &save); v;
+           v = strtok_r(NULL, ",", &save)) {
+        if (d->num_values == MAX_VALUES) {
+          printf("%s: too many values of %s\n", argv[0], d->name);
+          exit(1);
+        }
+        d->values[d->num_values++] = strtoll(v, NULL, 0);
+      }
+      break;
+    }
+    case 'h':
+      usage(argv);
+      exit(0);
+    default:
+      usage(argv);
+      exit(1);
+    }
+  }
+  if (optind == argc || m.s < 0 || m.s > 24 || m.E <= 0 || m.E > 4096 ||
+      m.b < 0 || m.b > 32) {
+    usage(argv);
+    exit(1);
+  }
+
+  candidate **cands = allocate(MAX_CANDIDATES * sizeof(candidate *));
+  int num_cands = 0;
+  char label[256] = "";
+  for (int i = optind; i < argc; i++) {
+    spec *sp = allocate(sizeof(spec));
+    parseSpec(argv[i], sp);
+    expandDefines(sp, defines, num_defines, 0, label, cands, &num_cands);
+    free(sp);
+  }
+
+  m.lines = allocate(((size_t)m.E << m.s) * sizeof(uint64_t));
+  m.fill = allocate(sizeof(int) << m.s);
+  if (trace) {
+    if (num_cands != 1) {
+      printf("%s: -t takes a single candidate\n", argv[0]);
+      exit(1);
+    }
+    m.trace = stdout;
+    runCandidate(cands[0], &m);
+    return 0;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < num_cands; i++) {
+    runCandidate(cands[i], &m);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double ms = (end.tv_sec - start.tv_sec) * 1e3 +
+              (end.tv_nsec - start.tv_nsec) / 1e6;
+
+  bool all_match = true;
+  if (check) {
+    for (int i = 0; i < num_cands; i++) {
+      cands[i]->checked = true;
+      cands[i]->matches = checkCandidate(cands[i], &m);
+      all_match = all_match && cands[i]->matches;
+    }
+  }
+
+  qsort(cands, num_cands, sizeof(candidate *), byMisses);
+  printf("Predicted on s=%d, E=%d, b=%d:\n", m.s, m.E, m.b);
+  printf("%8s %8s %9s  %s\n", "misses", "hits", "evictions", "candidate");
+  for (int i = 0; i < num_cands; i++) {
+    candidate *cand = cands[i];
+    printf("%8lu %8lu %9lu  %s%s\n", cand->misses, cand->hits,
+           cand->evictions, cand->label,
+           !cand->checked  ? ""
+           : cand->matches ? " (matches csim)"
+                           : " (DIFFERS FROM CSIM)");
+  }
+  if (verbose) {
+    for (int i = 0; i < num_cands; i++) {
+      printBreakdown(cands[i]);
+    }
+  }
+  printf("%d candidate%s ranked in %.3f ms\n", num_cands,
+         num_cands == 1 ? "" : "s", ms);
+  return all_match ? 0 : 1;
+}
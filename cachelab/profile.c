@@ -0,0 +1,89 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "profile.h"
+
+#ifdef CSIM_PROFILE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+__thread prof_counters prof;
+static prof_counters total; /* of the threads merged so far */
+static pthread_mutex_t total_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t start_ns;
+static uint64_t start_cycles;
+
+static const char *phase_names[PROF_NUM_PHASES] = {
+    "parse", "wait", "decode", "lookup", "update", "evict",
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+void prof_start(void) {
+  start_ns = now_ns();
+  start_cycles = __rdtsc();
+}
+
+/* prof_merge - Add the counters of the calling thread to the totals. */
+void prof_merge(void) {
+  pthread_mutex_lock(&total_lock);
+  for (int i = 0; i < PROF_NUM_PHASES; i++) {
+    total.cycles[i] += prof.cycles[i];
+    total.events[i] += prof.events[i];
+  }
+  for (int i = 0; i <= PROF_MAX_DEPTH; i++) {
+    total.depths[i] += prof.depths[i];
+  }
+  pthread_mutex_unlock(&total_lock);
+  memset(&prof, 0, sizeof(prof));
+}
+
+/*
+ * prof_report - Print the time spent per phase on stderr, summed over the
+ * threads, which must have ended, so the shares can add up to more than
+ * 100%. Cycles are converted to nanoseconds with the TSC rate measured over
+ * the whole run.
+ */
+void prof_report(uint64_t accesses) {
+  uint64_t elapsed_ns = now_ns() - start_ns;
+  uint64_t elapsed_cycles = __rdtsc() - start_cycles;
+  prof_merge();
+  double ns_per_cycle =
+      elapsed_cycles ? (double)elapsed_ns / elapsed_cycles : 0.0;
+  uint64_t probes = 0;
+  int max_depth = 0;
+
+  fprintf(stderr, "%-8s %12s %12s %10s %8s\n", "phase", "events", "ms",
+          "ns/event", "share");
+  for (int i = 0; i < PROF_NUM_PHASES; i++) {
+    double ms = total.cycles[i] * ns_per_cycle / 1e6;
+    fprintf(stderr, "%-8s %12lu %12.3f %10.2f %7.1f%%\n", phase_names[i],
+            total.events[i], ms,
+            total.events[i] ? ms * 1e6 / total.events[i] : 0.0,
+            elapsed_cycles ? 100.0 * total.cycles[i] / elapsed_cycles : 0.0);
+  }
+  fprintf(stderr, "total    %12lu %12.3f   (%.0f accesses/s)\n", accesses,
+          elapsed_ns / 1e6,
+          elapsed_ns ? accesses * 1e9 / elapsed_ns : 0.0);
+
+  for (int i = 0; i <= PROF_MAX_DEPTH; i++) {
+    probes += total.depths[i];
+    if (total.depths[i]) {
+      max_depth = i;
+    }
+  }
+  fprintf(stderr, "splay depth of looked up tags (%lu probes):\n", probes);
+  for (int i = 0; i <= max_depth; i++) {
+    fprintf(stderr, "  %s%2d %12lu %7.2f%%\n", i == PROF_MAX_DEPTH ? ">=" : "  ",
+            i, total.depths[i],
+            probes ? 100.0 * total.depths[i] / probes : 0.0);
+  }
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * profile.h - Hot path instrumentation for csim. Everything here expands to
+ * nothing unless csim is built with -DCSIM_PROFILE (make csim-prof).
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+typedef enum {
+  PROF_PARSE, /* on the reader's thread, overlaps the others when threaded */
+  PROF_WAIT,  /* for the reader thread to hand over a batch */
+  PROF_DECODE,
+  PROF_LOOKUP,
+  PROF_UPDATE,
+  PROF_EVICT,
+  PROF_NUM_PHASES,
+} prof_phase;
+
+#ifdef CSIM_PROFILE
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+/* Splay depths at or above this are counted in the last bucket. */
+#define PROF_MAX_DEPTH 32
+
+/*
+ * Every thread counts in its own prof and adds it to the totals with
+ * prof_merge() before it ends, so the pool workers, the pipelined levels
+ * and the trace readers never race on a counter.
+ */
+typedef struct prof_counters {
+  uint64_t cycles[PROF_NUM_PHASES];
+  uint64_t events[PROF_NUM_PHASES];
+  uint64_t depths[PROF_MAX_DEPTH + 1];
+} prof_counters;
+
+extern __thread prof_counters prof;
+
+void prof_start(void);
+void prof_merge(void);
+void prof_report(uint64_t accesses);
+
+#define PROF_START() prof_start()
+#define PROF_MERGE() prof_merge()
+#define PROF_BEGIN(phase) uint64_t prof_begin_##phase = __rdtsc()
+#define PROF_END(phase) PROF_END_COUNT(phase, 1)
+/* PROF_END for a phase that covered n events. */
+#define PROF_END_COUNT(phase, n)                                               \
+  do {                                                                         \
+    prof.cycles[phase] += __rdtsc() - prof_begin_##phase;                      \
+    prof.events[phase] += (n);                                                 \
+  } while (0)
+#define PROF_DEPTH(depth)                                                      \
+  do {                                                                         \
+    uint64_t prof_depth = (depth);                                             \
+    prof.depths[prof_depth < PROF_MAX_DEPTH ? prof_depth : PROF_MAX_DEPTH]++;  \
+  } while (0)
+#define PROF_REPORT(accesses) prof_report(accesses)
+
+#else
+
+#define PROF_START()
+#define PROF_MERGE()
+#define PROF_BEGIN(phase)
+#define PROF_END(phase)
+#define PROF_END_COUNT(phase, n)
+#define PROF_DEPTH(depth)
+#define PROF_REPORT(accesses)
+
+#endif
+
+#endif
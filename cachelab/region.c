@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "region.h"
+
+/*
+ * region_map_load - Read a region map, a line "name start end" per region
+ * with the addresses in hex and end exclusive, as tracegen writes it.
+ * Returns false if the file cannot be read or holds too many regions.
+ */
+bool region_map_load(region_map *m, const char *file_name) {
+  FILE *fp = fopen(file_name, "r");
+  if (!fp) {
+    return false;
+  }
+  memset(m, 0, sizeof(*m));
+  char name[REGION_NAME_LENGTH];
+  uint64_t start, end;
+  int fields;
+  while ((fields = fscanf(fp, "%31s %lx %lx", name, &start, &end)) == 3) {
+    if (m->num_regions == REGION_MAX || end <= start) {
+      fclose(fp);
+      return false;
+    }
+    strcpy(m->names[m->num_regions], name);
+    m->starts[m->num_regions] = start;
+    m->ends[m->num_regions] = end;
+    m->num_regions++;
+  }
+  fclose(fp);
+  strcpy(m->names[m->num_regions], "other");
+  return fields == EOF;
+}
+
+/*
+ * region_find - The region of an address, the first one that contains it,
+ * or num_regions for none. Maps are a handful of arrays, a scan is enough.
+ */
+int region_find(const region_map *m, uint64_t address) {
+  for (int i = 0; i < m->num_regions; i++) {
+    if (address >= m->starts[i] && address < m->ends[i]) {
+      return i;
+    }
+  }
+  return m->num_regions;
+}
+
+/*
+ * region_access - Count an access, and the repeat_hits to the same line
+ * after it, for the region of its address. An eviction is also charged to
+ * the pair of the region of the access and the region of the evicted line.
+ */
+void region_access(region_map *m, const mem_access *access, int repeat_hits,
+                   cache_result result, const cache_update *update,
+                   int num_block_bits) {
+  int r = region_find(m, access->address);
+  region_stats *stats = &m->stats[r];
+  stats->hits += (result == CACHE_HIT) + (access->mode == MODIFY) +
+                 repeat_hits;
+  stats->misses += result != CACHE_HIT;
+  if (result == CACHE_EVICTION) {
+    stats->evictions++;
+    m->evicted[r][region_find(m, update->victim_block << num_block_bits)]++;
+  }
+}
+
+void region_reset_stats(region_map *m) {
+  memset(m->stats, 0, sizeof(m->stats));
+  memset(m->evicted, 0, sizeof(m->evicted));
+}
+
+/*
+ * region_print - Print the counts of every region, and of other if any
+ * access fell outside them, then every pair of regions with evictions.
+ */
+void region_print(const region_map *m) {
+  for (int i = 0; i <= m->num_regions; i++) {
+    const region_stats *stats = &m->stats[i];
+    if (i == m->num_regions && stats->hits + stats->misses == 0) {
+      break;
+    }
+    printf("region %s hits:%lu misses:%lu evictions:%lu\n", m->names[i],
+           stats->hits, stats->misses, stats->evictions);
+  }
+  for (int by = 0; by <= m->num_regions; by++) {
+    for (int whose = 0; whose <= m->num_regions; whose++) {
+      if (m->evicted[by][whose]) {
+        printf("region %s evicted region %s:%lu\n", m->names[by],
+               m->names[whose], m->evicted[by][whose]);
+      }
+    }
+  }
+}
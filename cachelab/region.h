@@ -0,0 +1,41 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "trace.h"
+
+#define REGION_MAX 16
+#define REGION_NAME_LENGTH 32
+
+typedef struct region_stats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions; /* caused by accesses to the region */
+} region_stats;
+
+/*
+ * Named address ranges [start, end) of a trace, such as the arrays of a
+ * kernel. Accesses outside all of them go to an extra region "other" at
+ * index num_regions. evicted counts which region evicted lines of which.
+ */
+typedef struct region_map {
+  int num_regions;
+  char names[REGION_MAX + 1][REGION_NAME_LENGTH];
+  uint64_t starts[REGION_MAX];
+  uint64_t ends[REGION_MAX];
+  region_stats stats[REGION_MAX + 1];
+  uint64_t evicted[REGION_MAX + 1][REGION_MAX + 1]; /* [by][whose] */
+} region_map;
+
+bool region_map_load(region_map *m, const char *file_name);
+int region_find(const region_map *m, uint64_t address);
+void region_access(region_map *m, const mem_access *access, int repeat_hits,
+                   cache_result result, const cache_update *update,
+                   int num_block_bits);
+void region_reset_stats(region_map *m);
+void region_print(const region_map *m);
+
+#endif
@@ -0,0 +1,364 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "result_cache.h"
+
+#define ENTRY_MAGIC "csim result 1"
+#define HASH_CHUNK (1 << 20)
+
+/* The capture to undo if the simulation exits before it is stored. */
+static result_cache *capturing = NULL;
+
+static void release(result_cache *rc);
+
+static void *allocate(size_t size) {
+  void *p = malloc(size);
+  if (!p) {
+    printf("malloc failed");
+    exit(1);
+  }
+  return p;
+}
+
+/*
+ * hash_words - Continue the hash of a byte stream with data, a multiple of
+ * 8 bytes long unless it is the end of the stream.
+ */
+static uint64_t hash_words(uint64_t h, const unsigned char *data,
+                           size_t size) {
+  uint64_t word;
+  for (; size >= 8; size -= 8, data += 8) {
+    memcpy(&word, data, 8);
+    h = (h ^ word) * 0x9e3779b97f4a7c15UL;
+    h ^= h >> 29;
+  }
+  if (size) {
+    word = 0;
+    memcpy(&word, data, size);
+    h = (h ^ word) * 0x9e3779b97f4a7c15UL;
+    h ^= h >> 29;
+  }
+  return h;
+}
+
+/* hash_final - Mix the length into the hash and let every bit avalanche. */
+static uint64_t hash_final(uint64_t h, uint64_t length) {
+  h ^= length;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9UL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebUL;
+  return h ^ (h >> 31);
+}
+
+static bool hash_file(const char *file_name, uint64_t *hash) {
+  FILE *fp = fopen(file_name, "rb");
+  if (!fp) {
+    return false;
+  }
+  unsigned char *chunk = allocate(HASH_CHUNK);
+  uint64_t h = 0, length = 0;
+  size_t size;
+  while ((size = fread(chunk, 1, HASH_CHUNK, fp)) > 0) {
+    h = hash_words(h, chunk, size);
+    length += size;
+  }
+  bool ok = !ferror(fp);
+  fclose(fp);
+  free(chunk);
+  *hash = hash_final(h, length);
+  return ok;
+}
+
+/*
+ * write_file - Replace a file of the cache directory with head and body,
+ * through a temporary file so that a concurrent reader sees either the old
+ * or the new contents.
+ */
+static void write_file(const char *path, const char *head, const char *body,
+                       size_t body_size) {
+  char tmp[strlen(path) + 32];
+  sprintf(tmp, "%s.%d", path, (int)getpid());
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp) {
+    return;
+  }
+  fputs(head, fp);
+  if (body_size) {
+    fwrite(body, 1, body_size, fp);
+  }
+  if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+    unlink(tmp);
+  }
+}
+
+/*
+ * file_hash - The content hash of a file. It is taken from the note in the
+ * cache directory if the file kept its size and modification time since.
+ */
+static bool file_hash(result_cache *rc, const char *file_name,
+                      uint64_t *hash) {
+  struct stat st;
+  if (stat(file_name, &st) < 0) {
+    return false;
+  }
+  char note[strlen(rc->dir) + 64];
+  sprintf(note, "%s/file-%lx-%lx", rc->dir, (unsigned long)st.st_dev,
+          (unsigned long)st.st_ino);
+  FILE *fp = fopen(note, "r");
+  if (fp) {
+    uint64_t size, sec, nsec;
+    int fields = fscanf(fp, "%lu %lu %lu %lx", &size, &sec, &nsec, hash);
+    bool valid = fields == 4 && size == st.st_size &&
+                 sec == st.st_mtim.tv_sec && nsec == st.st_mtim.tv_nsec;
+    fclose(fp);
+    if (valid) {
+      return true;
+    }
+  }
+  if (!hash_file(file_name, hash)) {
+    return false;
+  }
+  char text[96];
+  sprintf(text, "%lu %lu %lu %016lx\n", (uint64_t)st.st_size,
+          (uint64_t)st.st_mtim.tv_sec, (uint64_t)st.st_mtim.tv_nsec, *hash);
+  write_file(note, text, NULL, 0);
+  return true;
+}
+
+/*
+ * result_cache_open - Open the cache in dir, creating it if needed, and
+ * start the key with the hash of the running simulator.
+ */
+bool result_cache_open(result_cache *rc, const char *dir) {
+  memset(rc, 0, sizeof(*rc));
+  rc->saved_stdout = -1;
+  if (mkdir(dir, 0777) < 0 && errno != EEXIST) {
+    return false;
+  }
+  rc->dir = strdup(dir);
+  uint64_t binary;
+  if (!rc->dir || !file_hash(rc, "/proc/self/exe", &binary)) {
+    result_cache_close(rc);
+    return false;
+  }
+  char text[32];
+  sprintf(text, "csim@%016lx", binary);
+  result_cache_add(rc, text);
+  return true;
+}
+
+void result_cache_close(result_cache *rc) {
+  if (rc->teeing) {
+    release(rc);
+  }
+  free(rc->dir);
+  free(rc->key);
+  free(rc->entry);
+  free(rc->output);
+  memset(rc, 0, sizeof(*rc));
+}
+
+/* result_cache_add - Append an option to the key. */
+void result_cache_add(result_cache *rc, const char *text) {
+  size_t len = strlen(text);
+  if (rc->key_len + len + 2 > rc->key_size) {
+    rc->key_size = 2 * (rc->key_len + len + 2);
+    rc->key = realloc(rc->key, rc->key_size);
+    if (!rc->key) {
+      printf("malloc failed");
+      exit(1);
+    }
+  }
+  if (rc->key_len) {
+    rc->key[rc->key_len++] = ' ';
+  }
+  strcpy(rc->key + rc->key_len, text);
+  rc->key_len += len;
+}
+
+/*
+ * result_cache_add_file - Append the content hash of an input file to the
+ * key. Fails if the file cannot be read.
+ */
+bool result_cache_add_file(result_cache *rc, const char *file_name) {
+  uint64_t hash;
+  if (!file_hash(rc, file_name, &hash)) {
+    return false;
+  }
+  char text[32];
+  sprintf(text, "@%016lx", hash);
+  result_cache_add(rc, text);
+  return true;
+}
+
+/*
+ * result_cache_replay - Print the output stored under the key and write
+ * the .csim_results of the run it came from. False if there is none.
+ */
+bool result_cache_replay(result_cache *rc) {
+  rc->entry = allocate(strlen(rc->dir) + 32);
+  sprintf(rc->entry, "%s/%016lx", rc->dir,
+          hash_final(hash_words(0, (unsigned char *)rc->key, rc->key_len),
+                     rc->key_len));
+  FILE *fp = fopen(rc->entry, "rb");
+  if (!fp) {
+    return false;
+  }
+  char *line = NULL;
+  size_t line_size = 0;
+  int hits, misses, evictions;
+  bool found = getline(&line, &line_size, fp) != -1 &&
+               strcmp(line, ENTRY_MAGIC "\n") == 0 &&
+               getline(&line, &line_size, fp) == rc->key_len + 1 &&
+               strncmp(line, rc->key, rc->key_len) == 0 &&
+               getline(&line, &line_size, fp) != -1 &&
+               sscanf(line, "%d %d %d", &hits, &misses, &evictions) == 3;
+  free(line);
+  if (!found) {
+    fclose(fp);
+    return false;
+  }
+  char buf[4096];
+  size_t size;
+  while ((size = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    fwrite(buf, 1, size, stdout);
+  }
+  fclose(fp);
+  FILE *results = fopen(".csim_results", "w");
+  if (results) {
+    fprintf(results, "%d %d %d\n", hits, misses, evictions);
+    fclose(results);
+  }
+  return true;
+}
+
+/*
+ * tee_output - Copy what the simulation prints to the real stdout as it
+ * comes, keeping it for the entry. Runs until stdout is restored. stdout
+ * leads back into the pipe here, so nothing is printed: if the copy cannot
+ * grow, the output is still passed on but the run is not stored.
+ */
+static void *tee_output(void *context) {
+  result_cache *rc = context;
+  char buf[4096];
+  for (;;) {
+    ssize_t n = read(rc->tee_fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    for (ssize_t done = 0; done < n;) {
+      ssize_t written = write(rc->saved_stdout, buf + done, n - done);
+      if (written < 0 && errno != EINTR) {
+        break;
+      }
+      done += written > 0 ? written : 0;
+    }
+    if (rc->output_lost) {
+      continue;
+    }
+    if (rc->output_size + n > rc->output_cap) {
+      char *output = realloc(rc->output, 2 * (rc->output_size + n));
+      if (!output) {
+        rc->output_lost = true;
+        continue;
+      }
+      rc->output = output;
+      rc->output_cap = 2 * (rc->output_size + n);
+    }
+    memcpy(rc->output + rc->output_size, buf, n);
+    rc->output_size += n;
+  }
+  return NULL;
+}
+
+/*
+ * release - Point stdout back at where it went before and wait for the
+ * tee to copy the rest of the output.
+ */
+static void release(result_cache *rc) {
+  fflush(stdout);
+  /* Closes the last write end of the pipe, the tee reads its end. */
+  dup2(rc->saved_stdout, STDOUT_FILENO);
+  pthread_join(rc->tee, NULL);
+  close(rc->tee_fd);
+  close(rc->saved_stdout);
+  rc->saved_stdout = -1;
+  rc->teeing = false;
+  capturing = NULL;
+}
+
+static void release_at_exit(void) {
+  if (capturing) {
+    release(capturing);
+  }
+}
+
+/*
+ * result_cache_capture - Send stdout through a pipe that a thread copies
+ * to the real stdout, keeping a copy to store once the simulation is done.
+ */
+void result_cache_capture(result_cache *rc) {
+  static bool registered = false;
+  int fds[2];
+  fflush(stdout);
+  if (pipe(fds) < 0) {
+    return;
+  }
+  rc->tee_fd = fds[0];
+  rc->saved_stdout = dup(STDOUT_FILENO);
+  if (rc->saved_stdout < 0 || dup2(fds[1], STDOUT_FILENO) < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    if (rc->saved_stdout >= 0) {
+      close(rc->saved_stdout);
+      rc->saved_stdout = -1;
+    }
+    return;
+  }
+  close(fds[1]);
+  /* Keep the buffering stdout had on a terminal. */
+  if (isatty(rc->saved_stdout)) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+  }
+  if (pthread_create(&rc->tee, NULL, tee_output, rc) != 0) {
+    dup2(rc->saved_stdout, STDOUT_FILENO);
+    close(rc->saved_stdout);
+    close(rc->tee_fd);
+    rc->saved_stdout = -1;
+    return;
+  }
+  rc->teeing = true;
+  if (!registered) {
+    atexit(release_at_exit);
+    registered = true;
+  }
+  capturing = rc;
+}
+
+/*
+ * result_cache_store - Stop capturing and store the output with the
+ * numbers the simulation summarized.
+ */
+void result_cache_store(result_cache *rc, int hits, int misses,
+                        int evictions) {
+  if (!rc->teeing) {
+    return;
+  }
+  release(rc);
+  if (rc->output_lost) {
+    return;
+  }
+  char *head = allocate(rc->key_len + 64);
+  sprintf(head, "%s\n%s\n%d %d %d\n", ENTRY_MAGIC, rc->key, hits, misses,
+          evictions);
+  write_file(rc->entry, head, rc->output, rc->output_size);
+  free(head);
+}
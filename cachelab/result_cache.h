@@ -0,0 +1,46 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Simulation results on disk, under a key made of the content hash of the
+ * simulator binary, so a rebuild invalidates them, and the options with
+ * every input file replaced by its content hash. The hash of a file is
+ * remembered next to the results with its size and modification time, so
+ * it is only computed again when the file changes.
+ *
+ * An entry holds the key, the numbers of printSummary() and everything the
+ * simulation printed. The output is teed while the simulation runs, so it
+ * still appears as it is printed.
+ */
+typedef struct result_cache {
+  char *dir;
+  char *key;
+  size_t key_size;
+  size_t key_len;
+  char *entry; /* file of the entry */
+  bool teeing;
+  pthread_t tee;
+  int tee_fd; /* read end of the pipe stdout goes to */
+  int saved_stdout;
+  char *output;
+  size_t output_size;
+  size_t output_cap;
+  bool output_lost; /* the copy could not grow, the run is not stored */
+} result_cache;
+
+bool result_cache_open(result_cache *rc, const char *dir);
+void result_cache_close(result_cache *rc);
+void result_cache_add(result_cache *rc, const char *text);
+bool result_cache_add_file(result_cache *rc, const char *file_name);
+bool result_cache_replay(result_cache *rc);
+void result_cache_capture(result_cache *rc);
+void result_cache_store(result_cache *rc, int hits, int misses,
+                        int evictions);
+
+#endif
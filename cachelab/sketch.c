@@ -0,0 +1,132 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sketch.h"
+
+static uint64_t mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15UL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+  return x ^ (x >> 31);
+}
+
+void hll_reset(hll *h) { memset(h->registers, 0, sizeof(h->registers)); }
+
+/*
+ * hll_add - The top bits of the hash pick a register, which keeps the
+ * longest run of leading zeros seen in the rest of the hash.
+ */
+void hll_add(hll *h, uint64_t key) {
+  uint64_t hash = mix(key);
+  uint64_t rest = hash << HLL_PRECISION | 1UL << (HLL_PRECISION - 1);
+  uint8_t rank = __builtin_clzl(rest) + 1;
+  uint8_t *reg = h->registers + (hash >> (64 - HLL_PRECISION));
+  if (rank > *reg) {
+    *reg = rank;
+  }
+}
+
+/*
+ * hll_estimate - The harmonic mean of the registers, with linear counting
+ * for small sets where most registers are still empty.
+ */
+uint64_t hll_estimate(const hll *h) {
+  double sum = 0;
+  int zeros = 0;
+  for (int i = 0; i < HLL_REGISTERS; i++) {
+    sum += ldexp(1, -h->registers[i]);
+    zeros += h->registers[i] == 0;
+  }
+  double m = HLL_REGISTERS;
+  double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+  if (estimate <= 2.5 * m && zeros) {
+    estimate = m * log(m / zeros);
+  }
+  return estimate + 0.5;
+}
+
+void count_min_initialize(count_min *cm, int k) {
+  memset(cm, 0, sizeof(*cm));
+  cm->k = k;
+}
+
+static void top_swap(count_min *cm, int a, int b) {
+  top_entry t = cm->top[a];
+  cm->top[a] = cm->top[b];
+  cm->top[b] = t;
+}
+
+/* top_sift_down - Restore the heap below position i after its count grew. */
+static void top_sift_down(count_min *cm, int i) {
+  for (;;) {
+    int smallest = i;
+    for (int child = 2 * i + 1; child <= 2 * i + 2; child++) {
+      if (child < cm->top_size &&
+          cm->top[child].count < cm->top[smallest].count) {
+        smallest = child;
+      }
+    }
+    if (smallest == i) {
+      return;
+    }
+    top_swap(cm, i, smallest);
+    i = smallest;
+  }
+}
+
+/*
+ * count_min_add - Count key once and update the top k. Estimates only grow,
+ * so a key already in the heap only ever sinks towards the bottom.
+ */
+void count_min_add(count_min *cm, uint64_t key) {
+  uint64_t hash = mix(key);
+  uint32_t estimate = UINT32_MAX;
+  for (int row = 0; row < COUNT_MIN_DEPTH; row++) {
+    uint32_t *counter =
+        &cm->counters[row][(hash >> (16 * row)) & (COUNT_MIN_WIDTH - 1)];
+    if (*counter < UINT32_MAX) {
+      (*counter)++;
+    }
+    if (*counter < estimate) {
+      estimate = *counter;
+    }
+  }
+
+  for (int i = 0; i < cm->top_size; i++) {
+    if (cm->top[i].key == key) {
+      cm->top[i].count = estimate;
+      top_sift_down(cm, i);
+      return;
+    }
+  }
+  if (cm->top_size < cm->k) {
+    int i = cm->top_size++;
+    cm->top[i].key = key;
+    cm->top[i].count = estimate;
+    while (i > 0 && cm->top[i].count < cm->top[(i - 1) / 2].count) {
+      top_swap(cm, i, (i - 1) / 2);
+      i = (i - 1) / 2;
+    }
+  } else if (cm->k > 0 && estimate > cm->top[0].count) {
+    cm->top[0].key = key;
+    cm->top[0].count = estimate;
+    top_sift_down(cm, 0);
+  }
+}
+
+static int compare_top(const void *a, const void *b) {
+  const top_entry *ta = a;
+  const top_entry *tb = b;
+  if (ta->count != tb->count) {
+    return ta->count < tb->count ? 1 : -1;
+  }
+  return ta->key < tb->key ? -1 : ta->key > tb->key;
+}
+
+/* count_min_top - Copy the top keys into top, highest count first. */
+int count_min_top(const count_min *cm, top_entry *top) {
+  memcpy(top, cm->top, cm->top_size * sizeof(top_entry));
+  qsort(top, cm->top_size, sizeof(top_entry), compare_top);
+  return cm->top_size;
+}
@@ -0,0 +1,42 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdint.h>
+
+/* HyperLogLog with 2^12 registers, about 1.6% standard error. */
+#define HLL_PRECISION 12
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+
+#define COUNT_MIN_DEPTH 4
+#define COUNT_MIN_WIDTH 4096
+#define SKETCH_MAX_TOP 64
+
+/* Estimates the number of distinct keys added since the last reset. */
+typedef struct hll {
+  uint8_t registers[HLL_REGISTERS];
+} hll;
+
+typedef struct top_entry {
+  uint64_t key;
+  uint64_t count;
+} top_entry;
+
+/*
+ * Count-min sketch of how often every key was added, with the k keys of the
+ * highest estimates in a min-heap, the smallest of them on top.
+ */
+typedef struct count_min {
+  uint32_t counters[COUNT_MIN_DEPTH][COUNT_MIN_WIDTH];
+  top_entry top[SKETCH_MAX_TOP];
+  int top_size;
+  int k;
+} count_min;
+
+void hll_reset(hll *h);
+void hll_add(hll *h, uint64_t key);
+uint64_t hll_estimate(const hll *h);
+void count_min_initialize(count_min *cm, int k);
+void count_min_add(count_min *cm, uint64_t key);
+int count_min_top(const count_min *cm, top_entry *top);
+
+#endif
@@ -0,0 +1,18 @@
+# A plain TxT blocked transpose of an NxM matrix, to search for the block
+# size: ./predict-trans -D T=4,8,16,23 -D M=61 -D N=67 specs/blocked.spec
+param M 32
+param N 32
+param T 8
+array A 0x100000 M
+array B 0x140000 N
+
+for row 0 N T
+  for col 0 M T
+    for i row min(row+T,N)
+      for j col min(col+T,M)
+        read A i j
+        write B j i
+      end
+    end
+  end
+end
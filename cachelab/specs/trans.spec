@@ -0,0 +1,12 @@
+# trans in trans.c: the simple row-wise scan.
+param M 32
+param N 32
+array A 0x100000 M
+array B 0x140000 N
+
+for i 0 N
+  for j 0 M
+    read A i j
+    write B j i
+  end
+end
@@ -0,0 +1,38 @@
+# transpose_32x32 in trans.c: 8x8 blocks, the diagonal ones go through
+# the first block of B so that A and B do not evict each other.
+param N 32
+array A 0x100000 N
+array B 0x140000 N
+
+for row 0 N 8
+  for col 0 N 8
+    if row != col
+      for i row row+8
+        for j col col+8
+          read A i j
+          write B j i
+        end
+      end
+    end
+  end
+end
+for blk 8 N 8
+  for i 0 8
+    for j 0 8
+      read A blk+i blk+j
+      write B j i
+    end
+  end
+  for i 0 8
+    for j 0 8
+      read B i j
+      write B blk+i blk+j
+    end
+  end
+end
+for i 0 8
+  for j 0 8
+    read A i j
+    write B j i
+  end
+end
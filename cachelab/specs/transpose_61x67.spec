@@ -0,0 +1,39 @@
+# transpose_61x67 in trans.c: 8x8 blocks, then the bottom rows and the
+# right columns that do not fill a block.
+param M 61
+param N 67
+array A 0x100000 M
+array B 0x140000 N
+
+for col 0 M-M%8 8
+  for row 0 N-N%8 8
+    for i row row+8
+      for j col col+8
+        read A i j
+        write B j i
+      end
+    end
+  end
+end
+for col 0 M-M%8 8
+  for i N-N%8 N
+    for j col col+8
+      read A i j
+      write B j i
+    end
+  end
+end
+for row 0 N-N%8 8
+  for i row row+8
+    for j M-M%8 M
+      read A i j
+      write B j i
+    end
+  end
+end
+for i N-N%8 N
+  for j M-M%8 M
+    read A i j
+    write B j i
+  end
+end
@@ -0,0 +1,90 @@
+# transpose_64x64 in trans.c: the right half of every 8x8 block of A is
+# parked in a diagonal block of B and moved to its place afterwards.
+param N 64
+array A 0x100000 N
+array B 0x140000 N
+
+for row 0 N 8
+  for col 0 N 8
+    if row != col
+      for i 0 8
+        for j 0 4
+          read A row+i col+j
+          write B col+j row+i
+        end
+        for j 4 8
+          read A row+i col+j
+          if row == 0
+            write B N-8+j N-8+i
+          else
+            write B j i
+          end
+        end
+      end
+      for i 4 8
+        for j 0 8
+          if row == 0
+            read B N-8+i N-8+j
+          else
+            read B i j
+          end
+          write B col+i row+j
+        end
+      end
+    end
+  end
+end
+for blk 16 N 8
+  for i 0 8
+    for j 0 4
+      read A blk+i blk+j
+      write B j i
+    end
+    for j 4 8
+      read A blk+i blk+j
+      write B j+8 i+8
+    end
+  end
+  for i 0 4
+    for j 0 8
+      read B i j
+      write B blk+i blk+j
+    end
+  end
+  for i 4 8
+    for j 0 8
+      read B i+8 j+8
+      write B blk+i blk+j
+    end
+  end
+end
+for i 0 8
+  for j 0 4
+    read A 8+i 8+j
+    write B j i
+  end
+end
+for i 0 8
+  for j 4 8
+    read A 8+i 8+j
+    write B j i
+  end
+end
+for i 0 8
+  for j 0 8
+    read B i j
+    write B 8+i 8+j
+  end
+end
+for i 0 8
+  for j 0 4
+    read A i j
+    write B j i
+  end
+end
+for i 0 8
+  for j 4 8
+    read A i j
+    write B j i
+  end
+end
@@ -128,3 +128,18 @@ void *splay_tree_search(splay_tree *t, void *item) {
   }
   return NULL;
 }
+
+/* Length of the search path for item, without splaying. */
+size_t splay_tree_depth(splay_tree *t, void *item) {
+  size_t depth = 0;
+  splay_tree_node *n = t->root;
+  while (n) {
+    int c = t->cmp(item, (char *)n - t->node_offset);
+    if (c == 0) {
+      break;
+    }
+    n = c < 0 ? n->left : n->right;
+    depth++;
+  }
+  return depth;
+}
@@ -21,5 +21,6 @@ void splay_tree_initialize(splay_tree *t, size_t node_offset,
 bool splay_tree_insert(splay_tree *t, void *item);
 bool splay_tree_remove(splay_tree *t, void *item);
 void *splay_tree_search(splay_tree *t, void *item);
+size_t splay_tree_depth(splay_tree *t, void *item);
 
 #endif
@@ -141,6 +141,17 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b) {
     /* Run the reference simulator */
     printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
     char cmd[255];
+
+    /* Break the accesses down per matrix, if the simulator is built. It
+       runs first, the reference simulator's .csim_results is the one
+       that counts. */
+    if (access("./csim", X_OK) == 0) {
+      sprintf(cmd,
+              "./csim -s %u -E %u -b %u -t trace.f%d --regions .regions "
+              "| grep '^region'",
+              s, E, b, i);
+      system(cmd);
+    }
     sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", s, E,
             b, i);
     system(cmd);
@@ -0,0 +1,452 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <zlib.h>
+#ifdef CSIM_ZSTD
+#include <zstd.h>
+#endif
+
+#include "profile.h"
+#include "trace.h"
+
+#define CHUNK_SIZE (1 << 20)
+
+/* Decompressed trace text, read a chunk at a time by the producer. */
+typedef struct trace_source {
+  trace_format format;
+  FILE *file;
+  gzFile gz;
+#ifdef CSIM_ZSTD
+  ZSTD_DStream *zstd;
+  ZSTD_inBuffer in;
+  char *in_buf;
+  size_t in_size;
+#endif
+  char *chunk;    /* CHUNK_SIZE bytes plus room for a final newline */
+  size_t len;     /* bytes in chunk */
+  size_t pos;     /* start of the next line in chunk */
+  int64_t offset; /* uncompressed trace offset of chunk[0] */
+  bool eof;
+  bool instructions; /* parse I lines instead of skipping them */
+} trace_source;
+
+static trace_format detect_format(FILE *file) {
+  unsigned char magic[4];
+  size_t got = fread(magic, 1, sizeof(magic), file);
+  rewind(file);
+  if (got >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    return TRACE_GZIP;
+  }
+  if (got == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+      magic[3] == 0xfd) {
+    return TRACE_ZSTD;
+  }
+  return TRACE_TEXT;
+}
+
+/* read_raw - Read up to size bytes of decompressed trace. */
+static size_t read_raw(trace_source *src, char *buf, size_t size) {
+  switch (src->format) {
+  case TRACE_TEXT:
+    return fread(buf, 1, size, src->file);
+  case TRACE_GZIP: {
+    int got = gzread(src->gz, buf, size);
+    if (got < 0) {
+      int err;
+      printf("Unable to decompress trace: %s.\n", gzerror(src->gz, &err));
+      exit(1);
+    }
+    return got;
+  }
+  case TRACE_ZSTD:
+#ifdef CSIM_ZSTD
+  {
+    ZSTD_outBuffer out = {buf, size, 0};
+    while (out.pos == 0) {
+      if (src->in.pos == src->in.size) {
+        src->in.size = fread(src->in_buf, 1, src->in_size, src->file);
+        src->in.pos = 0;
+        if (src->in.size == 0) {
+          break;
+        }
+      }
+      size_t ret = ZSTD_decompressStream(src->zstd, &out, &src->in);
+      if (ZSTD_isError(ret)) {
+        printf("Unable to decompress trace: %s.\n", ZSTD_getErrorName(ret));
+        exit(1);
+      }
+    }
+    return out.pos;
+  }
+#endif
+    break;
+  }
+  return 0;
+}
+
+/*
+ * refill - Move the partial line at the end of the chunk to the front and
+ * read more text behind it. The last line gets a newline if it lacks one.
+ */
+static bool refill(trace_source *src) {
+  if (src->eof) {
+    return false;
+  }
+  memmove(src->chunk, src->chunk + src->pos, src->len - src->pos);
+  src->offset += src->pos;
+  src->len -= src->pos;
+  src->pos = 0;
+  if (src->len == CHUNK_SIZE) {
+    printf("Trace line too long.\n");
+    exit(1);
+  }
+  size_t got = read_raw(src, src->chunk + src->len, CHUNK_SIZE - src->len);
+  if (got == 0) {
+    src->eof = true;
+    if (src->len == 0) {
+      return false;
+    }
+    src->chunk[src->len++] = '\n';
+    return true;
+  }
+  src->len += got;
+  return true;
+}
+
+static inline int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+/*
+ * parse_line - Parse a " M address,size" or "I  address,size" line. Empty
+ * lines are skipped, and so are instruction loads unless asked for.
+ */
+static bool parse_line(const char *p, const char *eol, bool instructions,
+                       mem_access *access) {
+  const char *digits;
+  int d;
+
+  if (p == eol || (*p == 'I' && !instructions)) {
+    return false;
+  }
+  if (*p == 'I') {
+    access->mode = INST;
+  } else if (*p != ' ' || eol - p < 3) {
+    printf("Malformed trace line: %.*s\n", (int)(eol - p), p);
+    exit(1);
+  } else {
+    switch (*(++p)) {
+    case 'L':
+      access->mode = LOAD;
+      break;
+    case 'S':
+      access->mode = STORE;
+      break;
+    case 'M':
+      access->mode = MODIFY;
+      break;
+    default:
+      printf("Unknown access mode: %c.\n", *p);
+      exit(1);
+    }
+  }
+  for (p++; p < eol && *p == ' '; p++) {
+  }
+  access->address = 0;
+  for (digits = p; p < eol && (d = hex_value(*p)) >= 0; p++) {
+    access->address = access->address << 4 | d;
+  }
+  if (p == digits) {
+    printf("Malformed trace line: %.*s\n", (int)(eol - digits), digits);
+    exit(1);
+  }
+  access->digits = p - digits < TRACE_MAX_DIGITS ? p - digits
+                                                 : TRACE_MAX_DIGITS;
+  access->size = 0;
+  if (p < eol && *p == ',') {
+    for (p++; p < eol && *p >= '0' && *p <= '9'; p++) {
+      access->size = access->size * 10 + (*p - '0');
+    }
+  }
+  return true;
+}
+
+/* fill_batch - Parse accesses into batch, false at the end of the trace. */
+static bool fill_batch(trace_source *src, trace_batch *batch) {
+  PROF_BEGIN(PROF_PARSE);
+  batch->count = 0;
+  while (batch->count < TRACE_BATCH_SIZE) {
+    char *line = src->chunk + src->pos;
+    char *eol = memchr(line, '\n', src->len - src->pos);
+    if (!eol) {
+      if (!refill(src)) {
+        break;
+      }
+      continue;
+    }
+    src->pos = eol + 1 - src->chunk;
+    if (parse_line(line, eol, src->instructions,
+                   batch->accesses + batch->count)) {
+      if (batch->count == 0) {
+        batch->offset = src->offset + (line - src->chunk);
+      }
+      batch->count++;
+    }
+  }
+  PROF_END_COUNT(PROF_PARSE, batch->count);
+  return batch->count > 0;
+}
+
+/*
+ * The producer owns head and the slots between tail and head, the consumer
+ * owns tail. Both sides yield instead of blocking when the ring is full or
+ * empty, there is no lock anywhere.
+ */
+static void *produce(void *arg) {
+  trace_reader *r = arg;
+  size_t head = r->head;
+  for (;;) {
+    while (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) ==
+           r->ring_depth) {
+      if (__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+        PROF_MERGE();
+        return NULL;
+      }
+      sched_yield();
+    }
+    if (__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE) ||
+        !fill_batch(r->source, r->ring + head % r->ring_depth)) {
+      break;
+    }
+    __atomic_store_n(&r->head, ++head, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n(&r->done, true, __ATOMIC_RELEASE);
+  PROF_MERGE();
+  return NULL;
+}
+
+/*
+ * trace_open - Open a trace for reading from the given uncompressed offset.
+ * The format is detected from the magic bytes. With a ring depth of 0 the
+ * trace is parsed on the calling thread. Instruction loads are only read
+ * when instructions is set.
+ */
+bool trace_open(trace_reader *r, const char *file_name, size_t ring_depth,
+                int64_t offset, bool instructions) {
+  trace_source *src = calloc(1, sizeof(trace_source));
+  if (!src) {
+    printf("malloc failed");
+    exit(1);
+  }
+  src->file = fopen(file_name, "rb");
+  if (!src->file) {
+    free(src);
+    return false;
+  }
+  src->format = detect_format(src->file);
+  switch (src->format) {
+  case TRACE_TEXT:
+    if (fseeko(src->file, offset, SEEK_SET) != 0) {
+      printf("Unable to seek trace file: %s.\n", file_name);
+      exit(1);
+    }
+    break;
+  case TRACE_GZIP:
+    fclose(src->file);
+    src->file = NULL;
+    src->gz = gzopen(file_name, "rb");
+    if (!src->gz) {
+      free(src);
+      return false;
+    }
+    gzbuffer(src->gz, CHUNK_SIZE);
+    if (gzseek(src->gz, offset, SEEK_SET) != offset) {
+      printf("Unable to seek trace file: %s.\n", file_name);
+      exit(1);
+    }
+    break;
+  case TRACE_ZSTD:
+#ifdef CSIM_ZSTD
+    src->zstd = ZSTD_createDStream();
+    src->in_size = ZSTD_DStreamInSize();
+    src->in_buf = malloc(src->in_size);
+    if (!src->zstd || !src->in_buf) {
+      printf("malloc failed");
+      exit(1);
+    }
+    ZSTD_initDStream(src->zstd);
+    src->in.src = src->in_buf;
+    break;
+#else
+    printf("Trace %s is zstd compressed, rebuild csim with ZSTD=1.\n",
+           file_name);
+    exit(1);
+#endif
+  }
+  src->chunk = malloc(CHUNK_SIZE + 1);
+  if (!src->chunk) {
+    printf("malloc failed");
+    exit(1);
+  }
+  src->offset = offset;
+  src->instructions = instructions;
+  if (src->format == TRACE_ZSTD) {
+    /* zstd streams cannot seek, decompress up to the offset instead. */
+    for (int64_t left = offset; left > 0;) {
+      size_t got = read_raw(src, src->chunk, left < CHUNK_SIZE ? left
+                                                               : CHUNK_SIZE);
+      if (got == 0) {
+        printf("Unable to seek trace file: %s.\n", file_name);
+        exit(1);
+      }
+      left -= got;
+    }
+  }
+
+  memset(r, 0, sizeof(*r));
+  r->format = src->format;
+  r->source = src;
+  r->ring_depth = ring_depth;
+  r->threaded = ring_depth > 0;
+  r->start_offset = offset;
+  r->ring = malloc((r->threaded ? ring_depth : 1) * sizeof(trace_batch));
+  if (!r->ring) {
+    printf("malloc failed");
+    exit(1);
+  }
+  if (r->threaded && pthread_create(&r->producer, NULL, produce, r) != 0) {
+    printf("Unable to start trace reader thread\n");
+    exit(1);
+  }
+  return true;
+}
+
+void trace_close(trace_reader *r) {
+  trace_source *src = r->source;
+  if (r->threaded) {
+    __atomic_store_n(&r->stop, true, __ATOMIC_RELEASE);
+    pthread_join(r->producer, NULL);
+  }
+  if (src->gz) {
+    gzclose(src->gz);
+  } else {
+    fclose(src->file);
+  }
+#ifdef CSIM_ZSTD
+  if (src->zstd) {
+    ZSTD_freeDStream(src->zstd);
+    free(src->in_buf);
+  }
+#endif
+  free(src->chunk);
+  free(src);
+  free(r->ring);
+}
+
+/*
+ * trace_next_batch - Release the current batch and wait for the next one.
+ */
+bool trace_next_batch(trace_reader *r) {
+  if (!r->threaded) {
+    r->current = r->ring;
+    r->pos = 0;
+    r->count = fill_batch(r->source, r->current) ? r->current->count : 0;
+    return r->count > 0;
+  }
+  if (r->current) {
+    __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+    r->current = NULL;
+    r->count = r->pos = 0;
+  }
+  PROF_BEGIN(PROF_WAIT);
+  while (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == r->tail) {
+    if (__atomic_load_n(&r->done, __ATOMIC_ACQUIRE) &&
+        __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == r->tail) {
+      PROF_END_COUNT(PROF_WAIT, 1);
+      return false;
+    }
+    sched_yield();
+  }
+  PROF_END_COUNT(PROF_WAIT, 1);
+  r->current = r->ring + r->tail % r->ring_depth;
+  r->count = r->current->count;
+  r->pos = 0;
+  return true;
+}
+
+/*
+ * trace_position - Where to reopen the trace to continue after the accesses
+ * handed out so far, minus the last unread ones: an offset to open at and a
+ * number of accesses to skip from there.
+ */
+void trace_position(trace_reader *r, size_t unread, int64_t *offset,
+                    uint64_t *skip) {
+  if (!r->current) {
+    *offset = r->start_offset;
+    *skip = 0;
+    return;
+  }
+  *offset = r->current->offset;
+  *skip = r->pos - unread;
+}
+
+/*
+ * trace_pack - Read the rest of the trace into a packed temporary file and
+ * map it.
+ */
+bool trace_pack(trace_reader *r, packed_trace *p) {
+  FILE *packed = tmpfile();
+  if (!packed) {
+    return false;
+  }
+  mem_access *chunk = malloc(TRACE_BATCH_SIZE * sizeof(mem_access));
+  if (!chunk) {
+    printf("malloc failed");
+    exit(1);
+  }
+  size_t n;
+  p->count = 0;
+  do {
+    for (n = 0; n < TRACE_BATCH_SIZE && trace_next(r, chunk + n); n++) {
+    }
+    if (fwrite(chunk, sizeof(mem_access), n, packed) != n) {
+      free(chunk);
+      fclose(packed);
+      return false;
+    }
+    p->count += n;
+  } while (n == TRACE_BATCH_SIZE);
+  free(chunk);
+  p->accesses = NULL;
+  if (fflush(packed) != 0) {
+    fclose(packed);
+    return false;
+  }
+  if (p->count > 0) {
+    p->accesses = mmap(NULL, p->count * sizeof(mem_access), PROT_READ,
+                       MAP_SHARED, fileno(packed), 0);
+    if (p->accesses == MAP_FAILED) {
+      fclose(packed);
+      return false;
+    }
+  }
+  fclose(packed);
+  return true;
+}
+
+void trace_unpack(packed_trace *p) {
+  if (p->count > 0) {
+    munmap(p->accesses, p->count * sizeof(mem_access));
+  }
+}
@@ -0,0 +1,93 @@
+/*
+ * trace.h - Trace ingest. A producer thread reads the trace, decompressing it
+ * if needed, and parses it into fixed-size batches of accesses that are
+ * handed to the simulation thread through a single-producer single-consumer
+ * ring of batches.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACE_BATCH_SIZE 4096
+#define TRACE_DEFAULT_RING_DEPTH 8
+
+typedef enum {
+  INST, /* instruction load, skipped unless the reader asks for them */
+  LOAD,
+  STORE,
+  MODIFY,
+} access_mode;
+
+#define TRACE_MAX_DIGITS 32 /* longer address texts are not echoed in full */
+
+typedef struct mem_access {
+  uint64_t address;
+  /* Only used for printing, accesses are assumed aligned. */
+  uint32_t size : 24;
+  uint32_t digits : 8; /* of the address in the trace, leading zeros too */
+  access_mode mode;
+} mem_access;
+
+typedef enum {
+  TRACE_TEXT,
+  TRACE_GZIP,
+  TRACE_ZSTD,
+} trace_format;
+
+typedef struct trace_batch {
+  mem_access accesses[TRACE_BATCH_SIZE];
+  size_t count;
+  int64_t offset; /* uncompressed trace offset of the first access's line */
+} trace_batch;
+
+struct trace_source;
+
+typedef struct trace_reader {
+  trace_format format;
+  struct trace_source *source;
+  trace_batch *ring;
+  size_t ring_depth; /* 0 parses on the consumer's thread */
+  bool threaded;
+  pthread_t producer;
+  size_t head __attribute__((aligned(64))); /* batches produced */
+  bool done;                                /* no batch after head */
+  bool stop;                                /* producer asked to quit */
+  size_t tail __attribute__((aligned(64))); /* batches consumed */
+  trace_batch *current; /* NULL before the first batch */
+  size_t count;         /* accesses in current */
+  size_t pos;           /* next access in current */
+  int64_t start_offset;
+} trace_reader;
+
+/*
+ * A whole trace in memory, parsed into accesses in a temporary file that is
+ * mapped read-only, so it can be shared between threads.
+ */
+typedef struct packed_trace {
+  mem_access *accesses;
+  uint64_t count;
+} packed_trace;
+
+bool trace_open(trace_reader *r, const char *file_name, size_t ring_depth,
+                int64_t offset, bool instructions);
+void trace_close(trace_reader *r);
+bool trace_next_batch(trace_reader *r);
+bool trace_pack(trace_reader *r, packed_trace *p);
+void trace_unpack(packed_trace *p);
+void trace_position(trace_reader *r, size_t unread, int64_t *offset,
+                    uint64_t *skip);
+
+/* trace_next - Get the next access, false at the end of the trace. */
+static inline bool trace_next(trace_reader *r, mem_access *access) {
+  if (r->pos == r->count && !trace_next_batch(r)) {
+    return false;
+  }
+  *access = r->current->accesses[r->pos++];
+  return true;
+}
+
+#endif
@@ -4,7 +4,8 @@
  *
  * The beginning and end of each registered transpose function's trace
  * is indicated by reading from "marker" addresses. These two marker
- * addresses are recorded in file for later use.
+ * addresses are recorded in file for later use, and so are the address
+ * ranges of the matrices.
  */
 
 #include "cachelab.h"
@@ -83,6 +84,14 @@ int main(int argc, char *argv[]) {
           (unsigned long long int)&MARKER_END);
   fclose(marker_fp);
 
+  /* Record where the matrices are, for per-region miss counts */
+  FILE *regions_fp = fopen(".regions", "w");
+  assert(regions_fp);
+  fprintf(regions_fp, "A %llx %llx\nB %llx %llx\n",
+          (unsigned long long int)A, (unsigned long long int)(A + 256),
+          (unsigned long long int)B, (unsigned long long int)(B + 256));
+  fclose(regions_fp);
+
   if (-1 == selectedFunc) {
     /* Invoke registered transpose functions */
     for (i = 0; i < func_counter; i++) {
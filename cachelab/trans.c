@@ -15,7 +15,7 @@ int is_transpose(int M, int N, int A[N][M], int B[M][N]);
 void trans(int M, int N, int A[N][M], int B[M][N]);
 void transpose_32x32(int N, int A[N][N], int B[N][N]);
 void transpose_64x64(int N, int A[N][N], int B[N][N]);
-void transpose_61x67(int M, int N, int A[N][N], int B[N][N]);
+void transpose_61x67(int M, int N, int A[N][M], int B[M][N]);
 
 /*
  * transpose_submit - This is the solution transpose function that you
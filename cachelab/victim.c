@@ -0,0 +1,120 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "victim.h"
+
+#define VICTIM_DIRTY (1UL << 63)
+
+void victim_initialize(victim_buffer *v, victim_kind kind, int num_entries,
+                       int num_block_bits) {
+  assert(num_entries > 0 && num_entries <= VICTIM_MAX_ENTRIES);
+  v->kind = kind;
+  v->num_entries = num_entries;
+  v->num_block_bits = num_block_bits;
+  v->blocks = calloc(num_entries, sizeof(uint64_t));
+  v->stamps = calloc(num_entries, sizeof(uint64_t));
+  if (!v->blocks || !v->stamps) {
+    printf("malloc failed");
+    exit(1);
+  }
+  v->clock = 0;
+}
+
+void victim_destroy(victim_buffer *v) {
+  free(v->blocks);
+  free(v->stamps);
+}
+
+static int find(const victim_buffer *v, uint64_t block) {
+  for (int i = 0; i < v->num_entries; i++) {
+    if (v->stamps[i] && v->blocks[i] == block) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*
+ * insert - Put block into an empty or the least recently used entry and
+ * return whether the line it displaced was dirty, and which line it was.
+ */
+static bool insert(victim_buffer *v, uint64_t block, bool dirty,
+                   uint64_t *displaced) {
+  int lru = 0;
+  for (int i = 0; i < v->num_entries; i++) {
+    if (v->stamps[i] == 0) {
+      lru = i;
+      break;
+    }
+    if ((v->stamps[i] & ~VICTIM_DIRTY) < (v->stamps[lru] & ~VICTIM_DIRTY)) {
+      lru = i;
+    }
+  }
+  bool displaced_dirty = v->stamps[lru] & VICTIM_DIRTY;
+  *displaced = v->blocks[lru];
+  v->blocks[lru] = block;
+  v->stamps[lru] = ++v->clock | (dirty ? VICTIM_DIRTY : 0);
+  return displaced_dirty;
+}
+
+/*
+ * victim_access - Probe the buffer after the cache handled an access and
+ * move lines between the two. The traffic in update is corrected for the
+ * lines the buffer supplied or absorbed: a victim cache only writes back
+ * the dirty lines it displaces itself.
+ */
+victim_result victim_access(victim_buffer *v, cache *c, cache_result result,
+                            cache_update *update) {
+  if (result == CACHE_HIT) {
+    return VICTIM_MISS;
+  }
+  uint64_t block_size = 1UL << v->num_block_bits;
+  int i = find(v, update->block);
+  if (v->kind == MISS_CACHE) {
+    if (i < 0) {
+      uint64_t displaced;
+      insert(v, update->block, false, &displaced);
+      return VICTIM_MISS;
+    }
+    v->stamps[i] = ++v->clock;
+    update->fill_bytes = 0;
+    return VICTIM_HIT;
+  }
+
+  if (i < 0) {
+    if (result == CACHE_EVICTION) {
+      bool dirty = insert(v, update->victim_block, update->victim_dirty,
+                          &update->writeback_block);
+      update->writeback_bytes = dirty ? block_size : 0;
+    }
+    return VICTIM_MISS;
+  }
+  if (v->stamps[i] & VICTIM_DIRTY) {
+    cache_set_dirty(c, update->slot);
+  }
+  update->fill_bytes = 0;
+  if (result != CACHE_EVICTION) {
+    v->stamps[i] = 0;
+    return VICTIM_HIT;
+  }
+  v->blocks[i] = update->victim_block;
+  v->stamps[i] = ++v->clock | (update->victim_dirty ? VICTIM_DIRTY : 0);
+  update->writeback_bytes = 0;
+  return VICTIM_SWAP;
+}
+
+/* victim_save - Write the clock followed by every entry. */
+void victim_save(const victim_buffer *v, FILE *fp) {
+  fwrite(&v->clock, sizeof(v->clock), 1, fp);
+  fwrite(v->blocks, sizeof(uint64_t), v->num_entries, fp);
+  fwrite(v->stamps, sizeof(uint64_t), v->num_entries, fp);
+}
+
+bool victim_restore(victim_buffer *v, FILE *fp) {
+  return fread(&v->clock, sizeof(v->clock), 1, fp) == 1 &&
+         fread(v->blocks, sizeof(uint64_t), v->num_entries, fp) ==
+             v->num_entries &&
+         fread(v->stamps, sizeof(uint64_t), v->num_entries, fp) ==
+             v->num_entries;
+}
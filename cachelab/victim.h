@@ -0,0 +1,47 @@
+#ifndef VICTIM_H
+#define VICTIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cache.h"
+
+/* Every lookup scans the whole buffer, so it has to stay small. */
+#define VICTIM_MAX_ENTRIES 64
+
+typedef enum {
+  VICTIM_NONE,
+  VICTIM_CACHE, /* receives the lines the cache evicts */
+  MISS_CACHE,   /* receives a copy of every line that misses */
+} victim_kind;
+
+typedef enum {
+  VICTIM_MISS,
+  VICTIM_HIT,  /* the missing line came from the buffer, not memory */
+  VICTIM_SWAP, /* a hit where the evicted line took its entry */
+} victim_result;
+
+/*
+ * A small fully associative buffer next to the cache, probed on every miss.
+ * Entries are whole block addresses in blocks. stamps holds the time of the
+ * last use, 0 for an empty entry, with bit 63 as dirty bit.
+ */
+typedef struct victim_buffer {
+  victim_kind kind;
+  int num_entries;
+  int num_block_bits;
+  uint64_t *blocks;
+  uint64_t *stamps;
+  uint64_t clock;
+} victim_buffer;
+
+void victim_initialize(victim_buffer *v, victim_kind kind, int num_entries,
+                       int num_block_bits);
+void victim_destroy(victim_buffer *v);
+victim_result victim_access(victim_buffer *v, cache *c, cache_result result,
+                            cache_update *update);
+void victim_save(const victim_buffer *v, FILE *fp);
+bool victim_restore(victim_buffer *v, FILE *fp);
+
+#endif